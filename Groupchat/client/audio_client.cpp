@@ -1,81 +1,172 @@
+#include "audio_client.h"
 #include <iostream>
-#include <thread>
-#include <vector>
-#include <mutex>
-#include <queue>
-#include <condition_variable>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
 #include <arpa/inet.h>
 
-class AudioClient {
-private:
-    int socket_fd;
-    std::string server_ip;
-    int server_port;
-    bool connected;
-    std::mutex audio_mutex;
-
-public:
-    AudioClient(const std::string& ip, int port) 
-        : server_ip(ip), server_port(port), connected(false) {}
-
-    bool connect() {
-        socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-        if (socket_fd == -1) {
-            std::cerr << "Failed to create socket" << std::endl;
+static bool recv_exact(int sock, char* buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(sock, buf + got, len - got, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
             return false;
         }
+        got += n;
+    }
+    return true;
+}
 
-        sockaddr_in server_addr;
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_port = htons(server_port);
-        inet_pton(AF_INET, server_ip.c_str(), &server_addr.sin_addr);
+AudioClient::AudioClient(const std::string& ip, int port)
+    : socket_fd(-1), server_ip(ip), server_port(port), connected(false),
+      group_id(0), next_seq(0) {}
 
-        if (::connect(socket_fd, (sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-            std::cerr << "Connection failed" << std::endl;
-            return false;
-        }
+AudioClient::~AudioClient() {
+    disconnect();
+}
 
-        connected = true;
-        std::cout << "Connected to audio server" << std::endl;
-        return true;
+bool AudioClient::connect() {
+    socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (socket_fd == -1) {
+        std::cerr << "Failed to create socket" << std::endl;
+        return false;
     }
 
-    void sendAudio(const std::vector<char>& audio_data) {
-        if (!connected) {
-            std::cerr << "Not connected to server" << std::endl;
-            return;
-        }
+    sockaddr_in server_addr{};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(server_port);
+    inet_pton(AF_INET, server_ip.c_str(), &server_addr.sin_addr);
 
-        std::lock_guard<std::mutex> lock(audio_mutex);
-        send(socket_fd, audio_data.data(), audio_data.size(), 0);
+    if (::connect(socket_fd, (sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        std::cerr << "Connection failed" << std::endl;
+        return false;
     }
 
-    std::vector<char> receiveAudio(size_t buffer_size = 4096) {
-        std::vector<char> buffer(buffer_size);
-        
-        int bytes_received = recv(socket_fd, buffer.data(), buffer_size, 0);
-        
-        if (bytes_received > 0) {
-            buffer.resize(bytes_received);
-            return buffer;
-        }
+    int one = 1;
+    setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    connected = true;
+    std::cout << "Connected to audio server" << std::endl;
+    return true;
+}
+
+void AudioClient::attach(int fd, uint16_t groupID) {
+    disconnect();
+    socket_fd = fd;
+    group_id = groupID;
+    connected = true;
+}
+
+bool AudioClient::joinGroup(uint16_t groupID) {
+    if (!connected) return false;
 
-        return std::vector<char>();
+    ChatPacket join = to_network(make_packet(MSG_AUDIO_JOIN, groupID, ""));
+    if (send(socket_fd, &join, sizeof(join), 0) != sizeof(join)) return false;
+
+    // Skip chat history/broadcasts until the server echoes the JOIN
+    while (true) {
+        ChatPacket pkt{};
+        if (!recv_exact(socket_fd, reinterpret_cast<char*>(&pkt), sizeof(pkt)))
+            return false;
+        if (pkt.type == MSG_AUDIO_JOIN) break;
     }
 
-    void disconnect() {
-        if (connected) {
-            close(socket_fd);
-            connected = false;
-            std::cout << "Disconnected from audio server" << std::endl;
+    group_id = groupID;
+    return true;
+}
+
+bool AudioClient::sendFrame(const void* data, size_t len) {
+    if (!connected || len > MAX_AUDIO_PAYLOAD) return false;
+
+    AudioFrameHeader hdr{};
+    hdr.seq           = next_seq++;
+    hdr.length        = len;
+    hdr.captureMicros = current_micros();
+    hdr.groupID       = group_id;
+    AudioFrameHeader net = to_network(hdr);
+
+    iovec iov[2];
+    iov[0].iov_base = &net;
+    iov[0].iov_len  = sizeof(net);
+    iov[1].iov_base = const_cast<void*>(data);
+    iov[1].iov_len  = len;
+
+    msghdr msg{};
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 2;
+
+    size_t remaining = sizeof(net) + len;
+    while (remaining > 0) {
+        ssize_t n = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        remaining -= n;
+
+        // Advance past what the kernel accepted
+        while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len) {
+            n -= msg.msg_iov->iov_len;
+            ++msg.msg_iov;
+            --msg.msg_iovlen;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = static_cast<char*>(msg.msg_iov->iov_base) + n;
+            msg.msg_iov->iov_len -= n;
         }
     }
+    return true;
+}
+
+void AudioClient::sendAudio(const std::vector<char>& audio_data) {
+    if (!connected) {
+        std::cerr << "Not connected to server" << std::endl;
+        return;
+    }
+    if (!sendFrame(audio_data.data(), audio_data.size())) {
+        std::cerr << "Failed to send audio frame" << std::endl;
+    }
+}
+
+bool AudioClient::receiveFrame(AudioFrameHeader& header, void* buf, size_t capacity) {
+    AudioFrameHeader net{};
+    if (!recv_exact(socket_fd, reinterpret_cast<char*>(&net), sizeof(net)))
+        return false;
+
+    header = to_host(net);
+    if (header.length > MAX_AUDIO_PAYLOAD)
+        return false;
+
+    size_t keep = header.length < capacity ? header.length : capacity;
+    if (!recv_exact(socket_fd, static_cast<char*>(buf), keep))
+        return false;
+
+    // Drain anything that did not fit so framing stays intact
+    char scratch[256];
+    for (size_t left = header.length - keep; left > 0; ) {
+        size_t chunk = left < sizeof(scratch) ? left : sizeof(scratch);
+        if (!recv_exact(socket_fd, scratch, chunk)) return false;
+        left -= chunk;
+    }
+    header.length = keep;
+    return true;
+}
+
+void AudioClient::interrupt() {
+    if (connected) {
+        shutdown(socket_fd, SHUT_RDWR);
+    }
+}
 
-    ~AudioClient() {
-        disconnect();
+void AudioClient::disconnect() {
+    if (connected) {
+        close(socket_fd);
+        connected = false;
+        std::cout << "Disconnected from audio server" << std::endl;
     }
-};
+}
@@ -0,0 +1,45 @@
+// client/audio_client.h
+#pragma once
+
+#include "shared/protocol.h"
+#include <string>
+#include <vector>
+
+// Framed connection to the server's audio relay. Sending and receiving
+// are each meant to be driven by one thread (see AudioPipeline), so
+// neither path takes a lock.
+class AudioClient {
+private:
+    int socket_fd;
+    std::string server_ip;
+    int server_port;
+    bool connected;
+    uint16_t group_id;
+    uint32_t next_seq;
+
+public:
+    AudioClient(const std::string& ip, int port);
+    ~AudioClient();
+
+    bool connect();
+
+    // Use an already-connected stream socket (e.g. one end of a socketpair)
+    void attach(int fd, uint16_t groupID);
+
+    // Switch the connection into audio relay mode for a group
+    bool joinGroup(uint16_t groupID);
+
+    // Send one frame (at most MAX_AUDIO_PAYLOAD bytes) as a single
+    // header+payload write, retrying short writes
+    bool sendFrame(const void* data, size_t len);
+    void sendAudio(const std::vector<char>& audio_data);
+
+    // Receive one relayed frame into buf; the host-order header is
+    // written to header. Bytes beyond capacity are discarded.
+    bool receiveFrame(AudioFrameHeader& header, void* buf, size_t capacity);
+
+    // Unblock a thread sitting in receiveFrame (used to stop pipelines)
+    void interrupt();
+
+    void disconnect();
+};
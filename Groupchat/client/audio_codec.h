@@ -0,0 +1,46 @@
+// client/audio_codec.h
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// G.711 mu-law: 16-bit linear PCM <-> 8-bit companded samples.
+// Halves the bytes on the wire and needs no allocation or state.
+namespace MuLaw {
+
+constexpr int BIAS = 0x84;
+constexpr int CLIP = 32635;
+
+inline uint8_t encodeSample(int16_t pcm) {
+    int sample = pcm;
+    int sign = (sample >> 8) & 0x80;
+    if (sign) sample = -sample;
+    if (sample > CLIP) sample = CLIP;
+    sample += BIAS;
+
+    int exponent = 7;
+    for (int mask = 0x4000; (sample & mask) == 0 && exponent > 0; mask >>= 1)
+        --exponent;
+
+    int mantissa = (sample >> (exponent + 3)) & 0x0F;
+    return static_cast<uint8_t>(~(sign | (exponent << 4) | mantissa));
+}
+
+inline int16_t decodeSample(uint8_t ulaw) {
+    ulaw = ~ulaw;
+    int sign = ulaw & 0x80;
+    int exponent = (ulaw >> 4) & 0x07;
+    int mantissa = ulaw & 0x0F;
+    int sample = (((mantissa << 3) + BIAS) << exponent) - BIAS;
+    return static_cast<int16_t>(sign ? -sample : sample);
+}
+
+inline void encode(const int16_t *pcm, uint8_t *out, size_t samples) {
+    for (size_t i = 0; i < samples; ++i) out[i] = encodeSample(pcm[i]);
+}
+
+inline void decode(const uint8_t *in, int16_t *pcm, size_t samples) {
+    for (size_t i = 0; i < samples; ++i) pcm[i] = decodeSample(in[i]);
+}
+
+} // namespace MuLaw
@@ -0,0 +1,71 @@
+// client/audio_main.cpp
+// Pipe-friendly audio client: raw 8 kHz 16-bit mono PCM on stdin is
+// streamed to the group, relayed audio from other members is written to
+// stdout, e.g.
+//   arecord -f S16_LE -r 8000 | ./audio_client 127.0.0.1 8080 7 | aplay -f S16_LE -r 8000
+// With --tone a 440 Hz test tone replaces stdin.
+#include "audio_pipeline.h"
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+// Reads whole frames of PCM from stdin; short reads are accumulated
+class StdinSource : public AudioSource {
+public:
+    size_t capture(int16_t *pcm, size_t maxSamples) override {
+        size_t want = (maxSamples < FRAME_SAMPLES ? maxSamples : FRAME_SAMPLES)
+                      * sizeof(int16_t);
+        size_t got = 0;
+        char *out = reinterpret_cast<char*>(pcm);
+        while (got < want) {
+            ssize_t n = read(STDIN_FILENO, out + got, want - got);
+            if (n <= 0) break;
+            got += n;
+        }
+        return got / sizeof(int16_t);
+    }
+};
+
+class StdoutSink : public AudioSink {
+public:
+    void play(const AudioFrameHeader &, const int16_t *pcm, size_t samples) override {
+        if (write(STDOUT_FILENO, pcm, samples * sizeof(int16_t)) < 0) {
+            // Player went away; nothing useful to do with the audio
+        }
+    }
+};
+
+int main(int argc, char *argv[]) {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    uint16_t group = 1;
+    bool tone = false;
+
+    int pos = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--tone") == 0) { tone = true; continue; }
+        switch (pos++) {
+            case 0: host = argv[i]; break;
+            case 1: port = std::stoi(argv[i]); break;
+            case 2: group = static_cast<uint16_t>(std::stoi(argv[i])); break;
+        }
+    }
+
+    AudioClient client(host, port);
+    if (!client.connect() || !client.joinGroup(group)) {
+        return 1;
+    }
+    std::cerr << "Streaming audio in group " << group << std::endl;
+
+    StdinSource stdinSource;
+    ToneSource toneSource;
+    StdoutSink sink;
+    AudioSource *source = tone ? static_cast<AudioSource*>(&toneSource)
+                               : static_cast<AudioSource*>(&stdinSource);
+
+    AudioPipeline pipeline(client, source, &sink);
+    pipeline.start();
+    pipeline.waitForSource();
+    pipeline.stop();
+    return 0;
+}
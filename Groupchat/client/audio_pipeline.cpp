@@ -0,0 +1,225 @@
+// client/audio_pipeline.cpp
+#include "audio_pipeline.h"
+#include "audio_codec.h"
+#include <cmath>
+
+namespace {
+
+// Waiting on an empty/full ring: spin briefly, then yield, then sleep.
+// Keeps hand-off latency low without burning a core when idle.
+class Backoff {
+public:
+    void pause() {
+        if (spins < 64) {
+            ++spins;
+        } else if (spins < 128) {
+            ++spins;
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    void reset() { spins = 0; }
+
+private:
+    int spins = 0;
+};
+
+} // namespace
+
+// ===== ToneSource =====
+
+ToneSource::ToneSource(double freqHz, bool paced, size_t maxFrames)
+    : phase(0.0), step(2.0 * M_PI * freqHz / SAMPLE_RATE), paced(paced),
+      maxFrames(maxFrames), produced(0),
+      next(std::chrono::steady_clock::now()) { }
+
+size_t ToneSource::capture(int16_t *pcm, size_t maxSamples) {
+    if (maxFrames && produced >= maxFrames) return 0;
+
+    if (paced) {
+        std::this_thread::sleep_until(next);
+        next += std::chrono::milliseconds(20);
+    }
+
+    size_t n = maxSamples < FRAME_SAMPLES ? maxSamples : FRAME_SAMPLES;
+    for (size_t i = 0; i < n; ++i) {
+        pcm[i] = static_cast<int16_t>(8000.0 * std::sin(phase));
+        phase += step;
+        if (phase > 2.0 * M_PI) phase -= 2.0 * M_PI;
+    }
+    ++produced;
+    return n;
+}
+
+// ===== NullSink =====
+
+void NullSink::play(const AudioFrameHeader &header,
+                    const int16_t *pcm, size_t samples) {
+    uint64_t now = current_micros();
+    uint64_t latency = now > header.captureMicros ? now - header.captureMicros : 0;
+
+    latencySum.fetch_add(latency, std::memory_order_relaxed);
+    if (latency > latencyMax.load(std::memory_order_relaxed))
+        latencyMax.store(latency, std::memory_order_relaxed);
+    if (samples) checksum += pcm[samples / 2];
+    played.fetch_add(1, std::memory_order_relaxed);
+}
+
+// ===== AudioPipeline =====
+
+AudioPipeline::AudioPipeline(AudioClient &client, AudioSource *source, AudioSink *sink)
+    : client(client), source(source), sink(sink),
+      txPool(new FramePool<POOL_FRAMES>()), rxPool(new FramePool<POOL_FRAMES>()),
+      captured(new Ring()), encoded(new Ring()),
+      receivedRing(new Ring()), decoded(new Ring()),
+      scratch(new PcmFrame()) { }
+
+AudioPipeline::~AudioPipeline() {
+    stop();
+}
+
+void AudioPipeline::start() {
+    running.store(true);
+    if (source) {
+        threads[0] = std::thread(&AudioPipeline::captureLoop, this);
+        threads[1] = std::thread(&AudioPipeline::encodeLoop, this);
+        threads[2] = std::thread(&AudioPipeline::sendLoop, this);
+    }
+    if (sink) {
+        threads[3] = std::thread(&AudioPipeline::receiveLoop, this);
+        threads[4] = std::thread(&AudioPipeline::decodeLoop, this);
+        threads[5] = std::thread(&AudioPipeline::playLoop, this);
+    }
+}
+
+void AudioPipeline::stop() {
+    if (!running.exchange(false)) return;
+    client.interrupt();
+    for (auto &t : threads) {
+        if (t.joinable()) t.join();
+    }
+}
+
+void AudioPipeline::waitForSource() {
+    if (threads[2].joinable()) threads[2].join();
+}
+
+void AudioPipeline::captureLoop() {
+    Backoff backoff;
+    const bool live = source->live();
+    while (running.load(std::memory_order_relaxed)) {
+        PcmFrame *f = txPool->acquire();
+        if (!f && !live) {
+            backoff.pause();
+            continue;
+        }
+        if (!f) {
+            // Sender is behind; live audio can't wait, so skip a frame
+            size_t n = source->capture(scratch->pcm, MAX_FRAME_SAMPLES);
+            if (n == 0) break;
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // At end of stream the frame is simply not returned: sendLoop is
+        // the pool's only producer, and the stream is over anyway
+        f->samples = source->capture(f->pcm, MAX_FRAME_SAMPLES);
+        if (f->samples == 0) break;
+        while (!captured->tryPush(f)) backoff.pause();
+        backoff.reset();
+    }
+    captureDone.store(true);
+}
+
+void AudioPipeline::encodeLoop() {
+    Backoff backoff;
+    PcmFrame *f = nullptr;
+    while (running.load(std::memory_order_relaxed)) {
+        if (!captured->tryPop(f)) {
+            if (captureDone.load() && captured->size() == 0) break;
+            backoff.pause();
+            continue;
+        }
+        backoff.reset();
+        MuLaw::encode(f->pcm, f->encoded, f->samples);
+        while (!encoded->tryPush(f)) backoff.pause();
+    }
+    encodeDone.store(true);
+}
+
+void AudioPipeline::sendLoop() {
+    Backoff backoff;
+    PcmFrame *f = nullptr;
+    bool ok = true;
+    while (running.load(std::memory_order_relaxed)) {
+        if (!encoded->tryPop(f)) {
+            if (encodeDone.load() && encoded->size() == 0) break;
+            backoff.pause();
+            continue;
+        }
+        backoff.reset();
+        if (ok) ok = client.sendFrame(f->encoded, f->samples);
+        if (ok) {
+            sent.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        txPool->release(f);
+    }
+    sendDone.store(true);
+}
+
+void AudioPipeline::receiveLoop() {
+    Backoff backoff;
+    while (running.load(std::memory_order_relaxed)) {
+        PcmFrame *f = rxPool->acquire();
+        if (!f) {
+            // Player is behind: keep the stream framed, drop this frame
+            if (!client.receiveFrame(scratch->header, scratch->encoded,
+                                     MAX_FRAME_SAMPLES))
+                break;
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // Kept out of the pool, which only playLoop may refill
+        if (!client.receiveFrame(f->header, f->encoded, MAX_FRAME_SAMPLES)) break;
+        f->samples = f->header.length;
+        received.fetch_add(1, std::memory_order_relaxed);
+        while (!receivedRing->tryPush(f)) backoff.pause();
+        backoff.reset();
+    }
+    receiveDone.store(true);
+}
+
+void AudioPipeline::decodeLoop() {
+    Backoff backoff;
+    PcmFrame *f = nullptr;
+    while (running.load(std::memory_order_relaxed)) {
+        if (!receivedRing->tryPop(f)) {
+            if (receiveDone.load() && receivedRing->size() == 0) break;
+            backoff.pause();
+            continue;
+        }
+        backoff.reset();
+        MuLaw::decode(f->encoded, f->pcm, f->samples);
+        while (!decoded->tryPush(f)) backoff.pause();
+    }
+    decodeDone.store(true);
+}
+
+void AudioPipeline::playLoop() {
+    Backoff backoff;
+    PcmFrame *f = nullptr;
+    while (running.load(std::memory_order_relaxed)) {
+        if (!decoded->tryPop(f)) {
+            if (decodeDone.load() && decoded->size() == 0) break;
+            backoff.pause();
+            continue;
+        }
+        backoff.reset();
+        sink->play(f->header, f->pcm, f->samples);
+        rxPool->release(f);
+    }
+}
@@ -0,0 +1,151 @@
+// client/audio_pipeline.h
+#pragma once
+
+#include "audio_client.h"
+#include "shared/spsc_ring.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+
+constexpr size_t SAMPLE_RATE   = 8000;
+constexpr size_t FRAME_SAMPLES = SAMPLE_RATE / 50;  // 20 ms per frame
+// mu-law is one byte per sample, so any relayed frame fits
+constexpr size_t MAX_FRAME_SAMPLES = MAX_AUDIO_PAYLOAD;
+
+// One preallocated frame; moves through the stages by pointer
+struct PcmFrame {
+    AudioFrameHeader header;  // host order, filled on receive
+    size_t samples;
+    int16_t pcm[MAX_FRAME_SAMPLES];
+    uint8_t encoded[MAX_FRAME_SAMPLES];
+};
+
+// Fixed set of frames recycled through a free-list ring. The last stage
+// releases frames and the first stage acquires them, so each pool has
+// exactly one producer and one consumer. A frame the first stage cannot
+// pass on (end of stream) stays out of the pool rather than being
+// released from a second thread.
+template <size_t N>
+class FramePool {
+public:
+    FramePool() {
+        for (size_t i = 0; i < N; ++i) freeList.tryPush(&frames[i]);
+    }
+
+    PcmFrame *acquire() {
+        PcmFrame *f = nullptr;
+        return freeList.tryPop(f) ? f : nullptr;
+    }
+
+    void release(PcmFrame *f) { freeList.tryPush(f); }
+
+private:
+    PcmFrame frames[N];
+    SpscRing<PcmFrame*, N> freeList;
+};
+
+// Produces PCM; returns 0 at end of stream
+class AudioSource {
+public:
+    virtual ~AudioSource() = default;
+    virtual size_t capture(int16_t *pcm, size_t maxSamples) = 0;
+
+    // Live sources (microphones) drop frames when the pipeline falls
+    // behind; non-live ones (files, benchmarks) wait for it instead
+    virtual bool live() const { return true; }
+};
+
+// Consumes decoded PCM along with the frame's relay header
+class AudioSink {
+public:
+    virtual ~AudioSink() = default;
+    virtual void play(const AudioFrameHeader &header,
+                      const int16_t *pcm, size_t samples) = 0;
+};
+
+// Synthetic sine tone. Paced mode releases one frame per 20 ms like a
+// sound card would; unpaced mode runs as fast as the pipeline drains.
+class ToneSource : public AudioSource {
+public:
+    ToneSource(double freqHz = 440.0, bool paced = true, size_t maxFrames = 0);
+    size_t capture(int16_t *pcm, size_t maxSamples) override;
+    bool live() const override { return paced; }
+
+private:
+    double phase;
+    double step;
+    bool paced;
+    size_t maxFrames;
+    size_t produced;
+    std::chrono::steady_clock::time_point next;
+};
+
+// Discards audio but keeps the statistics a real player would expose
+class NullSink : public AudioSink {
+public:
+    void play(const AudioFrameHeader &header,
+              const int16_t *pcm, size_t samples) override;
+
+    size_t frames() const { return played.load(); }
+    uint64_t totalLatencyMicros() const { return latencySum.load(); }
+    uint64_t maxLatencyMicros() const { return latencyMax.load(); }
+
+private:
+    std::atomic<size_t> played{0};
+    std::atomic<uint64_t> latencySum{0};
+    std::atomic<uint64_t> latencyMax{0};
+    int64_t checksum = 0;  // keeps the samples observably used
+};
+
+// capture -> encode -> send and recv -> decode -> play, one thread per
+// stage joined by SPSC rings. Either direction may be disabled by
+// passing a null source or sink. No allocation once start() returns.
+class AudioPipeline {
+public:
+    static constexpr size_t POOL_FRAMES = 32;
+
+    AudioPipeline(AudioClient &client, AudioSource *source, AudioSink *sink);
+    ~AudioPipeline();
+
+    void start();
+    void stop();
+
+    // Blocks until the source reports end of stream and all captured
+    // frames have been sent
+    void waitForSource();
+
+    size_t framesSent() const { return sent.load(); }
+    size_t framesReceived() const { return received.load(); }
+    size_t framesDropped() const { return dropped.load(); }
+
+private:
+    void captureLoop();
+    void encodeLoop();
+    void sendLoop();
+    void receiveLoop();
+    void decodeLoop();
+    void playLoop();
+
+    using Ring = SpscRing<PcmFrame*, POOL_FRAMES>;
+
+    AudioClient &client;
+    AudioSource *source;
+    AudioSink *sink;
+
+    std::unique_ptr<FramePool<POOL_FRAMES>> txPool, rxPool;
+    std::unique_ptr<Ring> captured, encoded, receivedRing, decoded;
+    std::unique_ptr<PcmFrame> scratch;  // sink for frames we have no room for
+
+    std::atomic<bool> running{false};
+    std::atomic<bool> captureDone{false};
+    std::atomic<bool> encodeDone{false};
+    std::atomic<bool> sendDone{false};
+    std::atomic<bool> receiveDone{false};
+    std::atomic<bool> decodeDone{false};
+
+    std::atomic<size_t> sent{0};
+    std::atomic<size_t> received{0};
+    std::atomic<size_t> dropped{0};
+
+    std::thread threads[6];
+};
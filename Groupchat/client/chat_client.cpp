@@ -1,10 +1,80 @@
 #include "chat_client.h"
+#include "shared/sha256.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
+#include <sstream>
 #include <thread>
+#include <vector>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+namespace {
+
+void print_packet(const ChatPacket &pkt) {
+    if (pkt.type == MSG_TEXT) {
+        std::cout << "[G" << pkt.groupID << "][" << pkt.senderName << "] "
+                  << pkt.payload << "\n";
+    } else if (pkt.type == MSG_SEARCH) {
+        std::cout << "[search][G" << pkt.groupID << "][" << pkt.senderName << "] "
+                  << pkt.payload << "\n";
+    } else if (pkt.type == MSG_SEARCH_DONE) {
+        std::cout << "[search] " << pkt.payload << "\n";
+    } else if (pkt.type == MSG_LIST_GROUPS) {
+        std::cout << "Active groups: " << pkt.payload << "\n";
+    } else if (pkt.type == MSG_TOP) {
+        std::cout << "[top] " << pkt.payload << "\n";
+    } else if (pkt.type == MSG_SUBSCRIBE || pkt.type == MSG_UNSUBSCRIBE) {
+        std::cout << "Receiving groups: " << pkt.payload << "\n";
+    } else if (pkt.type == MSG_HISTORY_GAP) {
+        std::istringstream fields(pkt.payload);
+        uint32_t since = 0, next = 0;
+        fields >> since >> next;
+        if (next > since + 1) {
+            std::cout << "[G" << pkt.groupID << "] " << next - since - 1
+                      << " earlier message(s) no longer available\n";
+        }
+    } else if (pkt.type == MSG_ATTACHMENT) {
+        std::istringstream fields(pkt.payload);
+        std::string hash, size, name;
+        fields >> hash >> size;
+        std::getline(fields >> std::ws, name);
+        std::cout << "[G" << pkt.groupID << "][" << pkt.senderName << "] shared "
+                  << name << " (" << size << " bytes): /get " << hash << "\n";
+    }
+}
+
+bool sendAll(int sock, const void *data, size_t len) {
+    const char *p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = send(sock, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool writeAll(int fd, const unsigned char *data, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
+
+} // namespace
+
 ChatClient::ChatClient(const std::string &host, int port)
     : host(host), port(port), sock(-1) { }
 
@@ -28,17 +98,19 @@ void ChatClient::connect_to_server() {
     std::cout << "Connected to server\n";
 }
 
-void ChatClient::send_loop() {
-    uint16_t currentGroup = 1;
+bool ChatClient::send_packet(const ChatPacket &pkt) {
+    ChatPacket net = to_network(pkt);
+    std::lock_guard<std::mutex> lock(sendMtx);
+    return sendAll(sock, &net, sizeof(net));
+}
 
+void ChatClient::send_loop() {
     // Get username
     std::cout << "Enter your username: ";
     std::getline(std::cin, username);
 
     // Auto-join group 1
-    ChatPacket joinPkt = make_packet(MSG_JOIN, currentGroup, "", 0, username);
-    ChatPacket netPkt = to_network(joinPkt);
-    send(sock, &netPkt, sizeof(netPkt), 0);
+    send_packet(make_packet(MSG_JOIN, currentGroup, "", 0, username));
 
     while (true) {
         std::string line;
@@ -47,9 +119,12 @@ void ChatClient::send_loop() {
         if (line.rfind("/switch ", 0) == 0) {
             int g = std::stoi(line.substr(8));
             currentGroup = g;
-            ChatPacket p = make_packet(MSG_SWITCH, g, "", 0, username);
-            ChatPacket n = to_network(p);
-            send(sock, &n, sizeof(n), 0);
+            // Back in a group seen before: only what came since
+            ChatPacket pkt = make_packet(MSG_SWITCH, g, "", 0, username);
+            SeenPosition seen = last_seen(g);
+            pkt.seq   = seen.seq;
+            pkt.epoch = seen.epoch;
+            send_packet(pkt);
             std::cout << "Switched to group " << g << "\n";
             continue;
         }
@@ -59,38 +134,272 @@ void ChatClient::send_loop() {
             exit(0);
         }
 
+        if (line == "/top") {
+            send_packet(make_packet(MSG_TOP, 0, "", 0, username));
+            continue;
+        }
+
         if (line.rfind("/list", 0) == 0) {
-            ChatPacket p = make_packet(MSG_LIST_GROUPS, 0, "", 0, username);
-            ChatPacket n = to_network(p);
-            send(sock, &n, sizeof(n), 0);
+            send_packet(make_packet(MSG_LIST_GROUPS, 0, "", 0, username));
+            continue;
+        }
+
+        if (line.rfind("/sub ", 0) == 0) {
+            send_packet(make_packet(MSG_SUBSCRIBE, currentGroup, line.substr(5), 0, username));
+            continue;
+        }
+
+        if (line.rfind("/unsub ", 0) == 0) {
+            send_packet(make_packet(MSG_UNSUBSCRIBE, currentGroup, line.substr(7), 0, username));
             continue;
         }
 
-        ChatPacket pkt = make_packet(MSG_TEXT, currentGroup, line, 0, username);
-        ChatPacket net = to_network(pkt);
-        send(sock, &net, sizeof(net), 0);
+        if (line.rfind("/search ", 0) == 0) {
+            send_packet(make_packet(MSG_SEARCH, currentGroup, line.substr(8), 0, username));
+            continue;
+        }
+
+        if (line.rfind("/find ", 0) == 0) {
+            send_packet(make_packet(MSG_FIND, currentGroup, line.substr(6), 0, username));
+            continue;
+        }
+
+        if (line.rfind("/send ", 0) == 0) {
+            offer_file(line.substr(6));
+            continue;
+        }
+
+        if (line.rfind("/get ", 0) == 0) {
+            std::istringstream args(line.substr(5));
+            std::string hash, path;
+            args >> hash >> path;
+            request_file(hash, path.empty() ? hash.substr(0, 16) : path);
+            continue;
+        }
+
+        send_packet(make_packet(MSG_TEXT, currentGroup, line, 0, username));
 
         std::cout << "[You] " << line << "\n";
     }
 }
 
 void ChatClient::receive_loop() {
+    RecvBuffer in(sizeof(ChatPacket));
     while (true) {
-        ChatPacket net{};
-        ssize_t bytes = recv(sock, &net, sizeof(net), 0);
-        if (bytes <= 0) {
+        if (in.fill(sock) <= 0) {
             std::cout << "Disconnected\n";
             exit(0);
         }
 
-        ChatPacket pkt = to_host(net);
-        if (pkt.type == MSG_TEXT) {
-            std::cout << "[G" << pkt.groupID << "][" << pkt.senderName << "] "
-                      << pkt.payload << "\n";
-        } else if (pkt.type == MSG_LIST_GROUPS) {
-            std::cout << "Active groups: " << pkt.payload << "\n";
+        bool synced = true;
+        in.drain([&](const unsigned char *frame) {
+            ChatPacket net;
+            std::memcpy(&net, frame, sizeof(net));
+            ChatPacket pkt = to_host(net);
+            track(pkt);
+            if (pkt.type == MSG_ATTACH_OFFER) {
+                on_offer_reply(pkt);
+            } else if (pkt.type == MSG_ATTACH_DATA) {
+                synced = on_data(pkt, in);
+            } else {
+                print_packet(pkt);
+            }
+            return synced;
+        });
+        if (!synced) {
+            std::cout << "Lost sync with server\n";
+            exit(1);
+        }
+    }
+}
+
+void ChatClient::track(const ChatPacket &pkt) {
+    std::lock_guard<std::mutex> lock(seqMtx);
+    if (pkt.type == MSG_HISTORY_GAP) {
+        lastSeen[pkt.groupID] = SeenPosition();
+    } else if (pkt.seq != 0 && (pkt.type == MSG_TEXT || pkt.type == MSG_ATTACHMENT)) {
+        lastSeen[pkt.groupID].advance(pkt);
+    }
+}
+
+SeenPosition ChatClient::last_seen(uint16_t groupID) {
+    std::lock_guard<std::mutex> lock(seqMtx);
+    auto it = lastSeen.find(groupID);
+    return it != lastSeen.end() ? it->second : SeenPosition();
+}
+
+void ChatClient::offer_file(const std::string &path) {
+    struct stat st{};
+    if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) {
+        std::cout << "[send] cannot read " << path << "\n";
+        return;
+    }
+    if (st.st_size == 0 || (uint64_t)st.st_size > MAX_ATTACHMENT) {
+        std::cout << "[send] " << path << " must be 1 byte to "
+                  << MAX_ATTACHMENT / (1024 * 1024) << " MB\n";
+        return;
+    }
+    std::string hash = Sha256::ofFile(path);
+    if (hash.empty()) {
+        std::cout << "[send] cannot read " << path << "\n";
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(transferMtx);
+        uploads[hash] = Upload{path, static_cast<uint64_t>(st.st_size)};
+    }
+    std::string name = path.substr(path.rfind('/') + 1);
+    send_packet(make_packet(MSG_ATTACH_OFFER, currentGroup,
+                            hash + " " + std::to_string(st.st_size) + " " + name,
+                            0, username));
+}
+
+// "<hash> <stored>": resume from `stored`, or done if that is the size
+void ChatClient::on_offer_reply(const ChatPacket &pkt) {
+    std::istringstream fields(pkt.payload);
+    std::string hash;
+    uint64_t stored = 0;
+    fields >> hash >> stored;
+    if (hash == "ERR") {
+        std::cout << "[send] " << pkt.payload << "\n";
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(transferMtx);
+    auto it = uploads.find(hash);
+    if (it == uploads.end()) return;
+    Upload file = it->second;
+    if (stored >= file.size) {
+        uploads.erase(it);
+        lock.unlock();
+        std::cout << "[send] " << file.path << " shared (" << hash << ")\n";
+        return;
+    }
+    lock.unlock();
+    if (stored > 0) std::cout << "[send] resuming " << file.path << " at " << stored << "\n";
+    std::thread(&ChatClient::upload, this, hash, file, stored).detach();
+}
+
+// Each chunk is a header and a sendfile() of its bytes, sent under the
+// send lock so typed messages go out between chunks
+void ChatClient::upload(std::string hash, Upload file, uint64_t offset) {
+    int fd = open(file.path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "[send] cannot read " << file.path << "\n";
+        return;
+    }
+    while (offset < file.size) {
+        uint64_t len = std::min<uint64_t>(MAX_ATTACH_CHUNK, file.size - offset);
+        ChatPacket header = to_network(make_packet(
+            MSG_ATTACH_CHUNK, 0,
+            hash + " " + std::to_string(offset) + " " + std::to_string(len), 0, username));
+
+        std::lock_guard<std::mutex> lock(sendMtx);
+        if (!sendAll(sock, &header, sizeof(header))) break;
+        off_t at = static_cast<off_t>(offset);
+        for (uint64_t left = len; left > 0;) {
+            ssize_t n = sendfile(sock, fd, &at, left);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                // The header promised `len` bytes; the stream cannot recover
+                std::cout << "[send] upload of " << file.path << " failed\n";
+                close(fd);
+                shutdown(sock, SHUT_RDWR);
+                return;
+            }
+            left -= n;
+        }
+        offset += len;
+    }
+    close(fd);
+}
+
+void ChatClient::request_file(const std::string &hash, const std::string &path) {
+    if (!Sha256::isDigest(hash)) {
+        std::cout << "[get] usage: /get <sha256> [path]\n";
+        return;
+    }
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        std::cout << "[get] cannot write " << path << "\n";
+        return;
+    }
+    // A partial file from an earlier /get resumes where it stopped
+    struct stat st{};
+    fstat(fd, &st);
+    {
+        std::lock_guard<std::mutex> lock(transferMtx);
+        auto old = downloads.find(hash);
+        if (old != downloads.end()) close(old->second.fd);
+        downloads[hash] = Download{path, fd};
+    }
+    send_packet(make_packet(MSG_ATTACH_GET, 0,
+                            hash + " " + std::to_string(st.st_size) + " " +
+                            std::to_string(MAX_ATTACH_CHUNK), 0, username));
+}
+
+// "<hash> <offset> <length> <size>" followed by `length` raw bytes.
+// Returns false if the body could not be read in full.
+bool ChatClient::on_data(const ChatPacket &pkt, RecvBuffer &in) {
+    std::istringstream fields(pkt.payload);
+    std::string hash;
+    uint64_t offset = 0, length = 0, size = 0;
+    fields >> hash >> offset >> length >> size;
+    if (hash == "ERR") {
+        std::cout << "[get] " << pkt.payload << "\n";
+        std::istringstream rest(pkt.payload);
+        std::string word;
+        while (rest >> word) hash = word;
+        std::lock_guard<std::mutex> lock(transferMtx);
+        auto it = downloads.find(hash);
+        if (it != downloads.end()) {
+            close(it->second.fd);
+            downloads.erase(it);
         }
+        return true;
+    }
+
+    Download file{"", -1};
+    {
+        std::lock_guard<std::mutex> lock(transferMtx);
+        auto it = downloads.find(hash);
+        if (it != downloads.end()) file = it->second;
+    }
+
+    // Body: what the last recv() already buffered, then the socket
+    const unsigned char *data;
+    size_t got = in.takeRaw(length, data);
+    bool ok = file.fd < 0 || writeAll(file.fd, data, got, offset);
+    std::vector<unsigned char> chunk(64 * 1024);
+    while (got < length) {
+        ssize_t n = recv(sock, chunk.data(), std::min<uint64_t>(chunk.size(), length - got), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        if (ok && file.fd >= 0) ok = writeAll(file.fd, chunk.data(), n, offset + got);
+        got += n;
+    }
+    if (file.fd < 0) return true;
+
+    if (ok && offset + length < size) {
+        send_packet(make_packet(MSG_ATTACH_GET, 0,
+                                hash + " " + std::to_string(offset + length) + " " +
+                                std::to_string(MAX_ATTACH_CHUNK), 0, username));
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(transferMtx);
+        close(file.fd);
+        downloads.erase(hash);
+    }
+    if (!ok) {
+        std::cout << "[get] cannot write " << file.path << "\n";
+    } else if (Sha256::ofFile(file.path) == hash) {
+        std::cout << "[get] saved " << file.path << " (" << size << " bytes)\n";
+    } else {
+        std::cout << "[get] " << file.path << " does not match " << hash << "\n";
     }
+    return true;
 }
 
 void ChatClient::run() {
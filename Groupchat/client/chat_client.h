@@ -1,8 +1,10 @@
-
 #pragma once
 
 #include "shared/protocol.h"
+#include "shared/recv_buffer.h"
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 class ChatClient {
 public:
@@ -11,12 +13,45 @@ public:
     void run();
 
 private:
+    // A file offered with /send, uploaded once the server says how much
+    // of it it already has
+    struct Upload {
+        std::string path;
+        uint64_t size;
+    };
+
+    // A /get in progress, written at the offsets the server sends
+    struct Download {
+        std::string path;
+        int fd;
+    };
+
     std::string host;
     int port;
     int sock;
     std::string username;
+    uint16_t currentGroup = 1;
+
+    // Uploads send a chunk at a time between chat packets
+    std::mutex sendMtx;
+    std::mutex transferMtx;  // guards uploads and downloads
+    std::unordered_map<std::string, Upload> uploads;       // by hash
+    std::unordered_map<std::string, Download> downloads;   // by hash
+
+    // Last sequence seen per group, sent on /switch back to it
+    std::mutex seqMtx;
+    std::unordered_map<uint16_t, SeenPosition> lastSeen;
 
     void connect_to_server();
     void send_loop();
     void receive_loop();
+    bool send_packet(const ChatPacket &pkt);
+    void track(const ChatPacket &pkt);
+    SeenPosition last_seen(uint16_t groupID);
+
+    void offer_file(const std::string &path);
+    void request_file(const std::string &hash, const std::string &path);
+    void on_offer_reply(const ChatPacket &pkt);
+    bool on_data(const ChatPacket &pkt, RecvBuffer &in);
+    void upload(std::string hash, Upload file, uint64_t offset);
 };
@@ -0,0 +1,374 @@
+// client/chat_connection.cpp
+#include "chat_connection.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t MAX_IOV = 64;       // queued packets per writev
+constexpr int MAX_EVENTS = 64;
+
+// +-20%, so connections dropped together don't all retry together
+std::chrono::milliseconds jittered(std::chrono::milliseconds d) {
+    thread_local std::minstd_rand rng(std::random_device{}());
+    std::uniform_int_distribution<int> percent(80, 120);
+    return d * percent(rng) / 100;
+}
+
+} // namespace
+
+ChatConnection::ChatConnection(ChatEventLoop &loop, Options options,
+                               PacketHandler onPacket, StateHandler onState)
+    : loop(loop), opts(std::move(options)), onPacket(std::move(onPacket)),
+      onState(std::move(onState)), current(State::BACKOFF), currentGroup(opts.group),
+      in(Wire::PACKET_SIZE), backoff(opts.minBackoff), retryAt(Clock::now()) { }
+
+bool ChatConnection::send(const ChatPacket &pkt) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (current == State::CLOSED || !enqueue(pkt)) return false;
+    // Write straight away unless the socket is already backed up; an
+    // error here surfaces on the loop as EPOLLERR
+    if (current == State::CONNECTED && !writeArmed) flush();
+    return true;
+}
+
+bool ChatConnection::sendText(const std::string &text) {
+    return send(make_packet(MSG_TEXT, group(), text, 0, opts.username));
+}
+
+bool ChatConnection::switchGroup(uint16_t g) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (current == State::CLOSED) return false;
+    if (current == State::CONNECTED) {
+        if (!enqueue(joinPacket(MSG_SWITCH, g))) return false;
+        if (!writeArmed) flush();
+    }
+    currentGroup = g;
+    return true;
+}
+
+bool ChatConnection::subscribe(uint16_t g) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (current == State::CLOSED) return false;
+    if (current == State::CONNECTED) {
+        if (!enqueue(make_packet(MSG_SUBSCRIBE, g, std::to_string(g), 0, opts.username)))
+            return false;
+        if (!writeArmed) flush();
+    }
+    subscriptions.insert(g);
+    return true;
+}
+
+bool ChatConnection::unsubscribe(uint16_t g) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (current == State::CLOSED) return false;
+    if (current == State::CONNECTED) {
+        if (!enqueue(make_packet(MSG_UNSUBSCRIBE, g, std::to_string(g), 0, opts.username)))
+            return false;
+        if (!writeArmed) flush();
+    }
+    subscriptions.erase(g);
+    return true;
+}
+
+void ChatConnection::close() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (current == State::CLOSED) return;
+        if (fd != -1) {
+            epoll_ctl(loop.epfd, EPOLL_CTL_DEL, fd, nullptr);
+            ::close(fd);
+            fd = -1;
+        }
+        current = State::CLOSED;
+        out.clear();
+    }
+    notify(State::CLOSED);
+}
+
+ChatConnection::State ChatConnection::state() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return current;
+}
+
+uint16_t ChatConnection::group() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return currentGroup;
+}
+
+size_t ChatConnection::queued() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return out.size();
+}
+
+void ChatConnection::notify(State s) {
+    if (onState) onState(*this, s);
+}
+
+bool ChatConnection::enqueue(const ChatPacket &pkt, bool front) {
+    // Rejoin packets go ahead of the queue and are never refused
+    if (!front && out.size() >= opts.maxQueued) return false;
+    Frame frame;
+    Wire::encode(pkt, frame.bytes);
+    if (front) {
+        out.push_front(frame);
+    } else {
+        out.push_back(frame);
+    }
+    return true;
+}
+
+// Write as much of the queue as the socket takes, several packets per
+// syscall. false on a socket error.
+bool ChatConnection::flush() {
+    while (!out.empty()) {
+        iovec iov[MAX_IOV];
+        size_t count = 0;
+        for (auto it = out.begin(); it != out.end() && count < MAX_IOV; ++it, ++count) {
+            size_t skip = count == 0 ? outOffset : 0;
+            iov[count].iov_base = it->bytes + skip;
+            iov[count].iov_len  = sizeof(it->bytes) - skip;
+        }
+
+        // writev() semantics, without SIGPIPE
+        msghdr msg{};
+        msg.msg_iov    = iov;
+        msg.msg_iovlen = count;
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            arm(true);
+            return true;
+        }
+        if (n < 0) return false;
+
+        size_t written = outOffset + static_cast<size_t>(n);
+        while (!out.empty() && written >= sizeof(Frame::bytes)) {
+            written -= sizeof(Frame::bytes);
+            out.pop_front();
+        }
+        outOffset = written;
+    }
+    arm(false);
+    return true;
+}
+
+void ChatConnection::arm(bool wantWrite) {
+    if (wantWrite == writeArmed || fd == -1) return;
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP | (wantWrite ? uint32_t(EPOLLOUT) : 0u);
+    ev.data.ptr = this;
+    epoll_ctl(loop.epfd, EPOLL_CTL_MOD, fd, &ev);
+    writeArmed = wantWrite;
+}
+
+// Connection lost: keep the queue, retry after the backoff. A packet
+// cut off mid-write is sent again whole on the next connection.
+void ChatConnection::drop() {
+    if (fd != -1) {
+        epoll_ctl(loop.epfd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        fd = -1;
+    }
+    in.reset();
+    outOffset = 0;
+    writeArmed = false;
+    current = State::BACKOFF;
+    retryAt = Clock::now() + jittered(backoff);
+    backoff = std::min(backoff * 2, opts.maxBackoff);
+}
+
+// Ahead of anything queued while disconnected
+void ChatConnection::rejoin() {
+    if (!subscriptions.empty()) {
+        std::string ids;
+        for (uint16_t g : subscriptions) ids += std::to_string(g) + " ";
+        enqueue(make_packet(MSG_SUBSCRIBE, currentGroup, ids, 0, opts.username), true);
+    }
+    enqueue(joinPacket(MSG_JOIN, currentGroup), true);
+}
+
+// JOIN/SWITCH carrying the last sequence seen in the group, so the
+// server sends only what is newer
+ChatPacket ChatConnection::joinPacket(MessageType type, uint16_t g) const {
+    ChatPacket pkt = make_packet(type, g, "", 0, opts.username);
+    auto it = lastSeen.find(g);
+    if (it != lastSeen.end()) {
+        pkt.seq   = it->second.seq;
+        pkt.epoch = it->second.epoch;
+    }
+    return pkt;
+}
+
+void ChatConnection::track(const ChatPacket &pkt) {
+    if (pkt.type == MSG_HISTORY_GAP) {
+        // The history that follows restarts the count
+        lastSeen[pkt.groupID] = SeenPosition();
+    } else if (pkt.seq != 0 && (pkt.type == MSG_TEXT || pkt.type == MSG_ATTACHMENT)) {
+        lastSeen[pkt.groupID].advance(pkt);
+    }
+}
+
+void ChatConnection::start() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (current != State::BACKOFF || Clock::now() < retryAt) return;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(opts.port);
+    if (inet_pton(AF_INET, opts.host.c_str(), &addr.sin_addr) != 1) {
+        drop();
+        return;
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        drop();
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        drop();
+        return;
+    }
+
+    // Writable once the connect completes (or fails)
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    ev.data.ptr = this;
+    epoll_ctl(loop.epfd, EPOLL_CTL_ADD, fd, &ev);
+    writeArmed = true;
+    current = State::CONNECTING;
+}
+
+ChatConnection::State ChatConnection::handle(uint32_t events,
+                                             std::vector<ChatPacket> &received) {
+    std::lock_guard<std::mutex> lock(mtx);
+    // Dropped or closed earlier in this batch of events
+    if (fd == -1) return current;
+
+    if (current == State::CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0 || (events & EPOLLERR)) {
+            drop();
+            return current;
+        }
+        if (!(events & EPOLLOUT)) return current;
+
+        current = State::CONNECTED;
+        backoff = opts.minBackoff;
+        if (connectedOnce) reconnectCount.fetch_add(1);
+        connectedOnce = true;
+        rejoin();
+        if (!flush()) drop();
+        return current;
+    }
+
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        // Edge or level, read until the socket is empty
+        while (true) {
+            ssize_t n = in.fill(fd);
+            if (n > 0) {
+                in.drain([&](const unsigned char *frame) {
+                    received.push_back(Wire::decode(frame));
+                    track(received.back());
+                    return true;
+                });
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            drop();
+            return current;
+        }
+    }
+    if ((events & EPOLLOUT) && !flush()) drop();
+    return current;
+}
+
+ChatEventLoop::ChatEventLoop()
+    : epfd(epoll_create1(EPOLL_CLOEXEC)), wakefd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (epfd < 0 || wakefd < 0) throw std::runtime_error("cannot create event loop");
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev);
+}
+
+ChatEventLoop::~ChatEventLoop() {
+    for (auto &c : connections) c->close();
+    ::close(wakefd);
+    ::close(epfd);
+}
+
+ChatConnection &ChatEventLoop::connect(ChatConnection::Options opts,
+                                       ChatConnection::PacketHandler onPacket,
+                                       ChatConnection::StateHandler onState) {
+    connections.emplace_back(new ChatConnection(*this, std::move(opts),
+                                                std::move(onPacket), std::move(onState)));
+    return *connections.back();
+}
+
+void ChatEventLoop::run(std::chrono::milliseconds timeout) {
+    using Clock = ChatConnection::Clock;
+    auto deadline = timeout.count() < 0 ? Clock::time_point::max() : Clock::now() + timeout;
+    epoll_event events[MAX_EVENTS];
+    std::vector<ChatPacket> received;
+
+    while (!stopping.load()) {
+        // (Re)connect whatever is due; the soonest retry bounds the wait
+        auto now = Clock::now();
+        auto wake = deadline;
+        for (auto &c : connections) {
+            c->start();
+            std::lock_guard<std::mutex> lock(c->mtx);
+            if (c->current == ChatConnection::State::BACKOFF) wake = std::min(wake, c->retryAt);
+        }
+        if (now >= deadline) break;
+
+        int waitMs = -1;
+        if (wake != Clock::time_point::max()) {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count();
+            waitMs = static_cast<int>(std::max<long long>(0, ms + 1));
+        }
+        int n = epoll_wait(epfd, events, MAX_EVENTS, waitMs);
+        if (n < 0 && errno != EINTR) break;
+
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.ptr == nullptr) {
+                uint64_t drained;
+                ssize_t ignored = read(wakefd, &drained, sizeof(drained));
+                (void)ignored;
+                continue;
+            }
+            auto *c = static_cast<ChatConnection*>(events[i].data.ptr);
+            received.clear();
+            ChatConnection::State before = c->state();
+            ChatConnection::State after = c->handle(events[i].events, received);
+            for (const auto &pkt : received) {
+                if (c->onPacket) c->onPacket(*c, pkt);
+            }
+            if (after != before) c->notify(after);
+        }
+    }
+    stopping.store(false);
+}
+
+void ChatEventLoop::stop() {
+    stopping.store(true);
+    uint64_t one = 1;
+    ssize_t ignored = write(wakefd, &one, sizeof(one));
+    (void)ignored;
+}
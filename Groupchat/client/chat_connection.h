@@ -0,0 +1,135 @@
+// client/chat_connection.h
+#pragma once
+
+#include "shared/protocol.h"
+#include "shared/recv_buffer.h"
+#include "shared/wire.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ChatEventLoop;
+
+// One chat connection driven by a ChatEventLoop. The socket is
+// non-blocking. Sends go through a bounded queue that is written with
+// writev() as the socket accepts it, and input is reassembled into
+// whole packets. When the connection drops it reconnects with
+// exponential backoff and rejoins its current group and subscriptions,
+// asking only for the messages after the last one it saw there.
+// Packets queued meanwhile are sent after the rejoin. It carries chat
+// packets only; attachment bodies are not handled.
+class ChatConnection {
+public:
+    enum class State { CONNECTING, CONNECTED, BACKOFF, CLOSED };
+
+    struct Options {
+        std::string host = "127.0.0.1";  // dotted quad
+        int port = 8080;
+        std::string username = "bot";
+        uint16_t group = 1;
+        size_t maxQueued = 1024;  // outbound packets
+        std::chrono::milliseconds minBackoff{100};
+        std::chrono::milliseconds maxBackoff{5000};
+    };
+
+    // Called on the loop thread, without the connection locked, so they
+    // may call send()
+    using PacketHandler = std::function<void(ChatConnection &, const ChatPacket &)>;
+    using StateHandler  = std::function<void(ChatConnection &, State)>;
+
+    // Thread-safe. false if the queue is full or the connection closed;
+    // the caller decides whether to drop or retry.
+    bool send(const ChatPacket &pkt);
+    bool sendText(const std::string &text);
+    // Remembered for rejoin; sent now only if connected
+    bool switchGroup(uint16_t group);
+    bool subscribe(uint16_t group);
+    bool unsubscribe(uint16_t group);
+    void close();
+
+    State state() const;
+    uint16_t group() const;
+    size_t queued() const;
+    uint64_t reconnects() const { return reconnectCount.load(); }
+    const std::string &username() const { return opts.username; }
+
+private:
+    friend class ChatEventLoop;
+    struct Frame {
+        unsigned char bytes[Wire::PACKET_SIZE];
+    };
+    using Clock = std::chrono::steady_clock;
+
+    ChatConnection(ChatEventLoop &loop, Options opts,
+                   PacketHandler onPacket, StateHandler onState);
+
+    // Loop thread only
+    void start();
+    State handle(uint32_t events, std::vector<ChatPacket> &received);
+    void notify(State s);
+
+    // Callers hold mtx
+    bool enqueue(const ChatPacket &pkt, bool front = false);
+    bool flush();
+    void arm(bool wantWrite);
+    void drop();
+    void rejoin();
+    void track(const ChatPacket &pkt);
+    ChatPacket joinPacket(MessageType type, uint16_t group) const;
+
+    ChatEventLoop &loop;
+    const Options opts;
+    PacketHandler onPacket;
+    StateHandler onState;
+
+    mutable std::mutex mtx;
+    int fd = -1;
+    State current = State::CLOSED;
+    uint16_t currentGroup;
+    std::set<uint16_t> subscriptions;
+    std::unordered_map<uint16_t, SeenPosition> lastSeen;  // by group
+    RecvBuffer in;
+    std::deque<Frame> out;
+    size_t outOffset = 0;       // bytes of out.front() already written
+    bool writeArmed = false;
+    std::chrono::milliseconds backoff;
+    Clock::time_point retryAt;
+    bool connectedOnce = false;
+    std::atomic<uint64_t> reconnectCount{0};
+};
+
+// epoll loop for any number of ChatConnections on one thread
+class ChatEventLoop {
+public:
+    ChatEventLoop();
+    ~ChatEventLoop();
+    ChatEventLoop(const ChatEventLoop &) = delete;
+    ChatEventLoop &operator=(const ChatEventLoop &) = delete;
+
+    // Starts connecting on the next run(); call from the loop thread
+    // or before it runs. The loop owns the connection.
+    ChatConnection &connect(ChatConnection::Options opts,
+                            ChatConnection::PacketHandler onPacket,
+                            ChatConnection::StateHandler onState = nullptr);
+
+    // Handle events until stop(), or until `timeout` has passed
+    // (negative: no limit)
+    void run(std::chrono::milliseconds timeout = std::chrono::milliseconds(-1));
+    // Any thread
+    void stop();
+
+private:
+    friend class ChatConnection;
+
+    int epfd;
+    int wakefd;  // eventfd, wakes epoll_wait for stop()
+    std::atomic<bool> stopping{false};
+    std::vector<std::unique_ptr<ChatConnection>> connections;
+};
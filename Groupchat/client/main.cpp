@@ -1,5 +1,6 @@
 // client/main.cpp
 #include "chat_client.h"
+#include <csignal>
 #include <iostream>
 
 int main(int argc, char *argv[]) {
@@ -9,6 +10,9 @@ int main(int argc, char *argv[]) {
     if (argc >= 2) host = argv[1];
     if (argc >= 3) port = std::stoi(argv[2]);
 
+    // Uploads use sendfile(), which has no MSG_NOSIGNAL
+    signal(SIGPIPE, SIG_IGN);
+
     ChatClient client(host, port);
     client.run();
     return 0;
@@ -0,0 +1,286 @@
+// server/attachment_store.cpp
+#include "attachment_store.h"
+#include "shared/protocol.h"
+#include "shared/metrics.h"
+#include "shared/sha256.h"
+#include "shared/logger.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+// One pipe per reader thread, reused for every chunk it splices
+struct SplicePipe {
+    int fds[2] = {-1, -1};
+    SplicePipe() {
+        if (pipe2(fds, O_CLOEXEC) < 0) fds[0] = fds[1] = -1;
+    }
+    ~SplicePipe() {
+        if (fds[0] != -1) close(fds[0]);
+        if (fds[1] != -1) close(fds[1]);
+    }
+};
+
+bool pwriteAll(int fd, const unsigned char *data, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
+
+// Plain recv + pwrite, for when splice() is unavailable
+bool copyIn(int sock, int fd, uint64_t offset, size_t len) {
+    std::vector<unsigned char> chunk(64 * 1024);
+    while (len > 0) {
+        ssize_t n = recv(sock, chunk.data(), std::min(len, chunk.size()), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        if (!pwriteAll(fd, chunk.data(), n, offset)) return false;
+        offset += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Socket -> pipe -> file inside the kernel. `spliced` counts the bytes
+// moved this way; if the socket cannot be spliced at all the rest is
+// copied instead.
+bool spliceIn(int sock, int fd, uint64_t offset, size_t len, uint64_t &spliced) {
+    thread_local SplicePipe pipe;
+    if (pipe.fds[0] == -1) return copyIn(sock, fd, offset, len);
+
+    while (len > 0) {
+        ssize_t n = splice(sock, nullptr, pipe.fds[1], nullptr, len,
+                           SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EINVAL && spliced == 0) return copyIn(sock, fd, offset, len);
+        if (n <= 0) return false;
+
+        // Empty the pipe into the file before reading more
+        loff_t at = static_cast<loff_t>(offset);
+        for (ssize_t left = n; left > 0;) {
+            ssize_t w = splice(pipe.fds[0], nullptr, fd, &at, left, SPLICE_F_MOVE);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            left -= w;
+        }
+        offset += n;
+        len -= n;
+        spliced += n;
+    }
+    return true;
+}
+
+// Read and drop a chunk body nobody wants, keeping the stream in sync
+bool discard(RecvBuffer &in, int sock, size_t len) {
+    const unsigned char *data;
+    len -= in.takeRaw(len, data);
+
+    unsigned char scratch[16 * 1024];
+    while (len > 0) {
+        ssize_t n = recv(sock, scratch, std::min(len, sizeof(scratch)), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        len -= n;
+    }
+    return true;
+}
+
+} // namespace
+
+AttachmentStore::AttachmentStore(const std::string &dir, uint64_t quota)
+    : dir(dir), quota(quota) {
+    mkdir(dir.c_str(), 0755);
+    std::lock_guard<std::mutex> lock(mtx);
+    sweep(true);
+}
+
+void AttachmentStore::sweep(bool force) {
+    time_t now = time(nullptr);
+    if (!force && now - lastSweep < SWEEP_INTERVAL_S) return;
+    lastSweep = now;
+
+    DIR *d = opendir(dir.c_str());
+    if (!d) return;
+    static const std::string PART = ".part";
+    uint64_t total = 0;
+    size_t expired = 0;
+    while (dirent *e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name == "." || name == "..") continue;
+        std::string path = dir + "/" + name;
+        struct stat st{};
+        if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) continue;
+
+        bool part = name.size() > PART.size() &&
+                    name.compare(name.size() - PART.size(), PART.size(), PART) == 0;
+        if (part) {
+            auto it = uploads.find(name.substr(0, name.size() - PART.size()));
+            if (it != uploads.end()) {
+                // Counted by what has been acknowledged, like receive()
+                total += it->second.received;
+                continue;
+            }
+            if (now - st.st_mtime >= PART_TTL_S && unlink(path.c_str()) == 0) {
+                ++expired;
+                continue;
+            }
+        }
+        total += st.st_size;
+    }
+    closedir(d);
+    used = total;
+    if (expired > 0) LOG_INFO("attachment_parts_expired", "count", expired, "bytes_used", used);
+}
+
+uint64_t AttachmentStore::pendingBytes() const {
+    uint64_t pending = 0;
+    for (const auto &pair : uploads) pending += pair.second.size - pair.second.received;
+    return pending;
+}
+
+bool AttachmentStore::complete(const std::string &hash, uint64_t &size) const {
+    struct stat st{};
+    if (stat(pathFor(hash).c_str(), &st) < 0) return false;
+    size = st.st_size;
+    return true;
+}
+
+int64_t AttachmentStore::begin(const std::string &hash, uint64_t size, int owner) {
+    if (!Sha256::isDigest(hash) || size == 0 || size > MAX_ATTACHMENT) return -1;
+
+    uint64_t stored;
+    if (complete(hash, stored)) return stored == size ? static_cast<int64_t>(size) : -1;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = uploads.find(hash);
+    if (it != uploads.end()) {
+        if (it->second.owner != owner || it->second.size != size) return -1;
+        return static_cast<int64_t>(it->second.received);
+    }
+
+    // Resume whatever an earlier connection left behind
+    sweep(false);
+    std::string part = pathFor(hash) + ".part";
+    int fd = ::open(part.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    struct stat st{};
+    fstat(fd, &st);
+    uint64_t received = st.st_size;
+    if (received > size) {
+        used -= std::min<uint64_t>(used, received);
+        received = 0;
+        if (ftruncate(fd, 0) < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    // Already-stored bytes of this upload are in `used`; the rest must fit
+    if (used + pendingBytes() + (size - received) > quota) {
+        close(fd);
+        if (received == 0) unlink(part.c_str());
+        LOG_WARN("attachment_quota_full", "hash", hash, "size", size,
+                 "bytes_used", used, "quota", quota);
+        return -1;
+    }
+    uploads.emplace(hash, Upload{owner, fd, size, received});
+    return static_cast<int64_t>(received);
+}
+
+AttachmentStore::Chunk AttachmentStore::receive(const std::string &hash, uint64_t offset,
+                                                uint32_t length, int owner,
+                                                RecvBuffer &in, int sock) {
+    Upload up{};
+    bool expected;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = uploads.find(hash);
+        // Chunks arrive in order, so only the next offset is accepted
+        expected = it != uploads.end() && it->second.owner == owner &&
+                   offset == it->second.received && length > 0 &&
+                   offset + length <= it->second.size;
+        if (expected) up = it->second;
+    }
+    if (!expected) {
+        return discard(in, sock, length) ? Chunk::REJECTED : Chunk::LOST;
+    }
+
+    // The chunk header's recv() usually pulled in the start of the body
+    const unsigned char *data;
+    size_t buffered = in.takeRaw(length, data);
+    if (!pwriteAll(up.fd, data, buffered, offset)) return Chunk::LOST;
+
+    uint64_t spliced = 0;
+    if (!spliceIn(sock, up.fd, offset + buffered, length - buffered, spliced)) {
+        return Chunk::LOST;
+    }
+    PerformanceMetrics::getInstance().recordAttachmentIn(length, spliced);
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = uploads.find(hash);
+        it->second.received += length;
+        used += length;
+        up = it->second;
+    }
+    return up.received == up.size ? finish(hash, up) : Chunk::STORED;
+}
+
+// The bytes never passed through user space, so the hash is checked by
+// reading the finished file back (from the page cache, normally)
+AttachmentStore::Chunk AttachmentStore::finish(const std::string &hash, Upload up) {
+    std::string part = pathFor(hash) + ".part";
+    close(up.fd);
+
+    Chunk result = Chunk::CORRUPT;
+    if (Sha256::ofFile(part) == hash) {
+        if (std::rename(part.c_str(), pathFor(hash).c_str()) == 0) {
+            result = Chunk::COMPLETE;
+            PerformanceMetrics::getInstance().incrementAttachmentStored();
+        }
+    } else {
+        unlink(part.c_str());
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (result == Chunk::CORRUPT) used -= std::min(used, up.size);
+    uploads.erase(hash);
+    return result;
+}
+
+void AttachmentStore::abandon(int owner) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto it = uploads.begin(); it != uploads.end();) {
+        if (it->second.owner != owner) {
+            ++it;
+            continue;
+        }
+        // Drop a half-written chunk so a resume starts on a boundary
+        int ignored = ftruncate(it->second.fd, it->second.received);
+        (void)ignored;
+        close(it->second.fd);
+        it = uploads.erase(it);
+    }
+}
+
+int AttachmentStore::open(const std::string &hash, uint64_t &size) const {
+    if (!Sha256::isDigest(hash)) return -1;
+    int fd = ::open(pathFor(hash).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st{};
+    fstat(fd, &st);
+    size = st.st_size;
+    return fd;
+}
@@ -0,0 +1,78 @@
+// server/attachment_store.h
+#pragma once
+
+#include "shared/recv_buffer.h"
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Uploaded attachments, one file per content hash
+constexpr const char *ATTACHMENT_DIR = "../Groupchat/logs/attachments";
+
+// Content-addressed attachment files. A complete upload is stored as
+// "<dir>/<sha256>" and shared by every group that links it; one still
+// arriving is "<sha256>.part" and outlives a dropped connection, so the
+// next offer of the same content resumes at its size. Chunk bodies are
+// spliced socket -> pipe -> file and downloads go out with sendfile(),
+// so file bytes are never copied through user space. Everything in the
+// directory counts against one byte quota, and a .part nobody has
+// touched for PART_TTL_S is deleted.
+class AttachmentStore {
+public:
+    static constexpr uint64_t DEFAULT_QUOTA  = 1ull << 30;  // bytes, complete + partial
+    static constexpr time_t PART_TTL_S       = 24 * 3600;
+    static constexpr time_t SWEEP_INTERVAL_S = 600;
+
+    enum class Chunk {
+        STORED,    // appended, more to come
+        COMPLETE,  // last chunk; hash verified and file published
+        REJECTED,  // not expected (offset, owner, size); body discarded
+        CORRUPT,   // complete but the hash did not match; upload dropped
+        LOST       // socket or disk error; connection is out of sync
+    };
+
+    explicit AttachmentStore(const std::string &dir = ATTACHMENT_DIR,
+                             uint64_t quota = DEFAULT_QUOTA);
+
+    // Start or resume an upload for `owner`. Returns the bytes already
+    // stored (== size once complete), or -1 if the offer is invalid,
+    // another connection is uploading the same content or the rest of
+    // it would not fit in the quota.
+    int64_t begin(const std::string &hash, uint64_t size, int owner);
+
+    // Take the `length` body bytes of a chunk header: whatever `in`
+    // already holds, then the rest straight from `sock`.
+    Chunk receive(const std::string &hash, uint64_t offset, uint32_t length,
+                  int owner, RecvBuffer &in, int sock);
+
+    // Leave the owner's uploads resumable and release them
+    void abandon(int owner);
+
+    // Read-only fd of a complete attachment (caller closes), or -1
+    int open(const std::string &hash, uint64_t &size) const;
+
+private:
+    struct Upload {
+        int owner;
+        int fd;
+        uint64_t size;
+        uint64_t received;
+    };
+
+    std::string pathFor(const std::string &hash) const { return dir + "/" + hash; }
+    bool complete(const std::string &hash, uint64_t &size) const;
+    Chunk finish(const std::string &hash, Upload up);
+    // Callers hold mtx. Deletes expired .part files and recounts `used`
+    // from the directory, at most every SWEEP_INTERVAL_S unless forced.
+    void sweep(bool force);
+    uint64_t pendingBytes() const;  // still to arrive for open uploads
+
+    std::string dir;
+    uint64_t quota;
+    std::mutex mtx;  // guards uploads, used and lastSweep; body I/O runs outside it
+    std::unordered_map<std::string, Upload> uploads;  // by hash
+    uint64_t used = 0;      // bytes stored, complete files and uploads so far
+    time_t lastSweep = 0;
+};
@@ -0,0 +1,192 @@
+// server/audio_relay.cpp
+#include "audio_relay.h"
+#include "shared/metrics.h"
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <algorithm>
+#include <cerrno>
+#include "shared/logger.h"
+
+namespace {
+
+// Read exactly len bytes; false on disconnect or error
+bool recv_exact(int sock, char *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(sock, buf + got, len - got, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+} // namespace
+
+AudioRelay::AudioRelay(size_t jitterDepth, uint32_t maxDelayMs)
+    : depth(jitterDepth), maxDelay(maxDelayMs) { }
+
+void AudioRelay::join(uint16_t groupID, const ReceiverPtr &r) {
+    std::lock_guard<std::mutex> lock(mtx);
+    groups[groupID].push_back(r);
+}
+
+void AudioRelay::leave(uint16_t groupID, int clientSocket) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = groups.find(groupID);
+    if (it == groups.end()) return;
+    auto &vec = it->second;
+    vec.erase(std::remove_if(vec.begin(), vec.end(),
+                             [clientSocket](const ReceiverPtr &r) {
+                                 return r->socket == clientSocket;
+                             }),
+              vec.end());
+    if (vec.empty()) groups.erase(it);
+}
+
+void AudioRelay::serve(int clientSocket, uint16_t groupID) {
+    // Frames are small and latency-bound; don't let Nagle batch them
+    int one = 1;
+    setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    auto self = std::make_shared<Receiver>();
+    self->socket = clientSocket;
+    join(groupID, self);
+
+    bool haveSeq = false;
+    uint32_t lastSeq = 0;
+
+    while (true) {
+        // Between incoming frames, push out what publish() could not
+        // send to this client, so the end of a talker's stream is not
+        // held until the next frame arrives
+        if (!awaitFrame(*self)) break;
+
+        AudioFrameHeader netHdr{};
+        if (!recv_exact(clientSocket, reinterpret_cast<char*>(&netHdr),
+                        sizeof(netHdr)))
+            break;
+
+        AudioFrameHeader hdr = to_host(netHdr);
+        if (hdr.length > MAX_AUDIO_PAYLOAD) {
+            LOG_WARN("audio_frame_too_large", "fd", clientSocket, "length", hdr.length);
+            break;
+        }
+
+        // Receive the payload straight into the buffer receivers send from
+        auto frame = std::make_shared<AudioFrame>();
+        frame->size = sizeof(AudioFrameHeader) + hdr.length;
+        frame->wire.reset(new char[frame->size]);
+        if (!recv_exact(clientSocket, frame->wire.get() + sizeof(AudioFrameHeader),
+                        hdr.length))
+            break;
+        frame->ingest = std::chrono::steady_clock::now();
+
+        // Out-of-order or replayed frames are already too late to play
+        if (haveSeq && (int32_t)(hdr.seq - lastSeq) <= 0) {
+            PerformanceMetrics::getInstance().incrementAudioLate();
+            continue;
+        }
+        haveSeq = true;
+        lastSeq = hdr.seq;
+
+        hdr.groupID  = groupID;
+        hdr.streamID = static_cast<uint16_t>(clientSocket);
+        AudioFrameHeader out = to_network(hdr);
+        std::memcpy(frame->wire.get(), &out, sizeof(out));
+
+        publish(groupID, clientSocket, frame);
+    }
+
+    leave(groupID, clientSocket);
+}
+
+bool AudioRelay::awaitFrame(Receiver &self) {
+    while (true) {
+        bool pending;
+        {
+            std::lock_guard<std::mutex> lock(self.mtx);
+            flush(self, std::chrono::steady_clock::now());
+            pending = !self.queue.empty();
+        }
+        // Writable wakes us to continue a backlog; the timeout also
+        // expires frames the socket never takes
+        pollfd pfd{self.socket, static_cast<short>(POLLIN | (pending ? POLLOUT : 0)), 0};
+        int n = poll(&pfd, 1, pending ? FLUSH_INTERVAL_MS : -1);
+        if (n < 0 && errno != EINTR) return false;
+        if (n > 0 && (pfd.revents & (POLLIN | POLLHUP | POLLERR))) return true;
+    }
+}
+
+void AudioRelay::publish(uint16_t groupID, int senderSocket,
+                         const AudioFramePtr &frame) {
+    auto &metrics = PerformanceMetrics::getInstance();
+
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = groups.find(groupID);
+    if (it == groups.end()) return;
+
+    for (const auto &r : it->second) {
+        if (r->socket == senderSocket) continue;
+
+        std::lock_guard<std::mutex> rlock(r->mtx);
+        if (r->queue.size() >= depth) {
+            // Buffer full: the oldest frame is the latest to play, drop it
+            // unless it is partially on the wire already
+            auto victim = r->sentOffset > 0 ? r->queue.begin() + 1
+                                            : r->queue.begin();
+            if (victim != r->queue.end()) {
+                r->queue.erase(victim);
+                metrics.incrementAudioOverflow();
+            }
+        }
+        r->queue.push_back(frame);
+        flush(*r, frame->ingest);
+    }
+}
+
+// Caller holds r.mtx. Sends without blocking; whatever the socket
+// cannot take stays queued for the next frame or the receiver's own
+// serve() loop.
+void AudioRelay::flush(Receiver &r, std::chrono::steady_clock::time_point now) {
+    auto &metrics = PerformanceMetrics::getInstance();
+
+    while (!r.queue.empty()) {
+        const AudioFrame &f = *r.queue.front();
+
+        if (r.sentOffset == 0 && now - f.ingest > maxDelay) {
+            r.queue.pop_front();
+            metrics.incrementAudioLate();
+            continue;
+        }
+
+        ssize_t n = send(r.socket, f.wire.get() + r.sentOffset,
+                         f.size - r.sentOffset, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;  // EAGAIN or a dead peer; its serve() loop cleans up
+        }
+
+        r.sentOffset += n;
+        if (r.sentOffset < f.size) return;
+
+        r.sentOffset = 0;
+        r.queue.pop_front();
+        metrics.incrementAudioRelayed();
+    }
+}
+
+void AudioRelay::flushAll() {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto &pair : groups) {
+        for (const auto &r : pair.second) {
+            std::lock_guard<std::mutex> rlock(r->mtx);
+            flush(*r, now);
+        }
+    }
+}
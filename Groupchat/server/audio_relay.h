@@ -0,0 +1,59 @@
+// server/audio_relay.h
+#pragma once
+
+#include "shared/protocol.h"
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// One received frame, kept in wire format (network-order header followed
+// by payload) so every receiver sends straight from the same buffer.
+struct AudioFrame {
+    std::chrono::steady_clock::time_point ingest;
+    size_t size;
+    std::unique_ptr<char[]> wire;
+};
+using AudioFramePtr = std::shared_ptr<const AudioFrame>;
+
+// Per-group audio relay. Each connection that sends MSG_AUDIO_JOIN is
+// served by serve(); frames it sends are forwarded to every other member
+// of its audio group through a bounded per-receiver jitter buffer.
+class AudioRelay {
+public:
+    AudioRelay(size_t jitterDepth = 8, uint32_t maxDelayMs = 100);
+
+    // Blocks relaying frames from clientSocket until it disconnects
+    void serve(int clientSocket, uint16_t groupID);
+
+    // Push out whatever is still queued (used on shutdown)
+    void flushAll();
+
+private:
+    struct Receiver {
+        int socket;
+        std::mutex mtx;
+        std::deque<AudioFramePtr> queue;  // jitter buffer
+        size_t sentOffset = 0;            // bytes of queue.front() already sent
+    };
+    using ReceiverPtr = std::shared_ptr<Receiver>;
+
+    static constexpr int FLUSH_INTERVAL_MS = 10;
+
+    // Waits for the next incoming frame while draining self's queue;
+    // false on a socket error
+    bool awaitFrame(Receiver &self);
+    void join(uint16_t groupID, const ReceiverPtr &r);
+    void leave(uint16_t groupID, int clientSocket);
+    void publish(uint16_t groupID, int senderSocket, const AudioFramePtr &frame);
+    void flush(Receiver &r, std::chrono::steady_clock::time_point now);
+
+    size_t depth;
+    std::chrono::milliseconds maxDelay;
+
+    std::mutex mtx;
+    // audio groupID -> receivers
+    std::unordered_map<uint16_t, std::vector<ReceiverPtr>> groups;
+};
@@ -0,0 +1,67 @@
+// server/bulk_lane.cpp
+#include "bulk_lane.h"
+
+BulkLane::BulkLane(size_t shardCount, size_t depth, Handler handler, ThreadStart onStart)
+    : depth(depth), handler(std::move(handler)) {
+    if (shardCount == 0) shardCount = 1;
+    for (size_t i = 0; i < shardCount; ++i) {
+        shards.emplace_back(new Shard());
+    }
+    for (size_t i = 0; i < shards.size(); ++i) {
+        Shard *s = shards[i].get();
+        s->worker = std::thread([this, s, i, onStart]() {
+            if (onStart) onStart(i);
+            work(*s);
+        });
+    }
+}
+
+BulkLane::~BulkLane() {
+    stop();
+}
+
+bool BulkLane::submit(const BulkJob &job) {
+    Shard &shard = *shards[job.groupID % shards.size()];
+    {
+        std::unique_lock<std::mutex> lock(shard.mtx);
+        if (shard.stopping) {
+            // Too late to queue; deliver from the caller instead
+            lock.unlock();
+            handler(job);
+            return true;
+        }
+        if (shard.jobs.size() >= depth) return false;
+        shard.jobs.push_back(job);
+    }
+    shard.notEmpty.notify_one();
+    return true;
+}
+
+void BulkLane::stop() {
+    for (auto &shard : shards) {
+        {
+            std::lock_guard<std::mutex> lock(shard->mtx);
+            shard->stopping = true;
+        }
+        shard->notEmpty.notify_all();
+    }
+    for (auto &shard : shards) {
+        if (shard->worker.joinable()) shard->worker.join();
+    }
+}
+
+void BulkLane::work(Shard &shard) {
+    while (true) {
+        BulkJob job;
+        {
+            std::unique_lock<std::mutex> lock(shard.mtx);
+            shard.notEmpty.wait(lock, [&]() {
+                return shard.stopping || !shard.jobs.empty();
+            });
+            if (shard.jobs.empty()) return;  // stopping and drained
+            job = shard.jobs.front();
+            shard.jobs.pop_front();
+        }
+        handler(job);
+    }
+}
@@ -0,0 +1,58 @@
+// server/bulk_lane.h
+#pragma once
+
+#include "shared/protocol.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A text message waiting for fan-out
+struct BulkJob {
+    int senderSocket;
+    uint16_t groupID;
+    ChatPacket pkt;  // host order
+    std::chrono::steady_clock::time_point queued;
+};
+
+// Bulk traffic (MSG_TEXT) is handed off here so connection readers never
+// block in a group's fan-out; they stay free to answer control requests
+// (join/switch/list) immediately. Jobs are sharded by group onto one
+// worker each, which keeps every group's messages in arrival order. A
+// full shard sheds the job rather than block the reader, so a shard
+// backed up behind one busy group can't stall unrelated connections.
+class BulkLane {
+public:
+    using Handler = std::function<void(const BulkJob &)>;
+    // Runs first on each shard's worker, with the shard index
+    using ThreadStart = std::function<void(size_t index)>;
+
+    BulkLane(size_t shards, size_t depth, Handler handler, ThreadStart onStart = nullptr);
+    ~BulkLane();
+
+    // False when the job's shard is full and the job was not taken
+    bool submit(const BulkJob &job);
+
+    // Runs everything already queued, then joins the workers
+    void stop();
+
+private:
+    struct Shard {
+        std::mutex mtx;
+        std::condition_variable notEmpty;
+        std::deque<BulkJob> jobs;
+        bool stopping = false;
+        std::thread worker;
+    };
+
+    void work(Shard &shard);
+
+    size_t depth;
+    Handler handler;
+    std::vector<std::unique_ptr<Shard>> shards;
+};
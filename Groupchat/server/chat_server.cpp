@@ -1,23 +1,130 @@
 #include "chat_server.h"
+#include "history_search.h"
 #include "shared/metrics.h"
-#include <iostream>
+#include "shared/logger.h"
+#include "shared/recv_buffer.h"
+#include <cerrno>
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
+#include <sstream>
+#include <stdexcept>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <vector>
 
-ChatServer::ChatServer(int port, size_t numThreads)
-    : port(port), server_fd(-1), pool(numThreads) { }
+namespace {
+
+// Cluster nodes and bus members on one host share logs/, so each keeps
+// its own index and snapshot ("index-node2", "cache_snapshot-bus1.bin")
+std::string instancePath(const std::string &base, const ClusterConfig &cfg,
+                         const ShmBus *bus) {
+    std::string tag;
+    if (cfg.enabled()) tag = "-node" + std::to_string(cfg.nodeID);
+    else if (bus)      tag = "-bus" + std::to_string(bus->memberID());
+    if (tag.empty()) return base;
+
+    size_t dot = base.rfind('.');
+    size_t slash = base.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return base + tag;
+    return base.substr(0, dot) + tag + base.substr(dot);
+}
+
+// "<title>: k1 n1, k2 n2, ..." with as many entries as fit a payload
+template <typename Entries, typename Format>
+std::string topLine(const std::string &title, const Entries &entries, Format format) {
+    std::string line = title + ":";
+    const char *sep = " ";
+    for (const auto &e : entries) {
+        std::string item = sep + format(e);
+        if (line.size() + item.size() >= sizeof(ChatPacket::payload)) break;
+        line += item;
+        sep = ", ";
+    }
+    return line;
+}
+
+std::string payloadText(const ChatPacket &pkt) {
+    return std::string(pkt.payload, strnlen(pkt.payload, sizeof(pkt.payload)));
+}
+
+void appendWire(std::vector<unsigned char> &out, const std::vector<ChatPacket> &packets) {
+    size_t at = out.size();
+    out.resize(at + packets.size() * Wire::PACKET_SIZE);
+    unsigned char wire[Wire::PACKET_SIZE];
+    for (size_t i = 0; i < packets.size(); ++i) {
+        Wire::encode(packets[i], wire);
+        std::memcpy(out.data() + at + i * Wire::PACKET_SIZE, wire, sizeof(wire));
+    }
+}
+
+} // namespace
+
+ChatServer::ChatServer(int port, size_t numThreads,
+                       const ClusterConfig &clusterConfig, const std::string &busName,
+                       size_t fanoutThreshold, const AffinityConfig &affinity)
+    : port(port), server_fd(-1),
+      bus(busName.empty() ? nullptr : ShmBus::attach(busName)),
+      snapshotPath(instancePath(CACHE_SNAPSHOT_PATH, clusterConfig, bus.get())),
+      workerPlacement(CpuTopology::detect(), affinity.mode, affinity.workerCpus),
+      ioPlacement(CpuTopology::detect(), affinity.mode, affinity.ioCpus),
+      pool(numThreads, [this](size_t i) { place_thread(workerPlacement, "worker", i); }),
+      groups(instancePath(INDEX_DIR, clusterConfig, bus.get()), fanoutThreshold,
+             [this](size_t i) { place_thread(ioPlacement, "fanout", i); }),
+      attachments(instancePath(ATTACHMENT_DIR, clusterConfig, bus.get())),
+      bulk(BULK_SHARDS, BULK_DEPTH, [this](const BulkJob &job) { deliver_text(job); },
+           [this](size_t i) { place_thread(ioPlacement, "bulk", i); }) {
+    if (clusterConfig.enabled()) {
+        cluster.reset(new Cluster(clusterConfig, groups));
+    }
+    if (!busName.empty() && !bus) {
+        throw std::runtime_error("cannot attach shared memory bus " + busName);
+    }
+    if (affinity.mode != Placement::NONE) {
+        if (!workerPlacement.enabled() || !ioPlacement.enabled()) {
+            throw std::runtime_error("none of the requested CPUs are usable by this process");
+        }
+        LOG_INFO("thread_placement", "mode", placementName(affinity.mode),
+                 "nodes", CpuTopology::detect().nodeCount(),
+                 "worker_cpus", workerPlacement.cpus().size(),
+                 "io_cpus", ioPlacement.cpus().size());
+    }
+}
+
+// Runs first on each long-lived server thread. Pinning before anything
+// else means the thread's stack, malloc arena and the per-connection
+// state it creates are first touched, and so placed, on its own node.
+void ChatServer::place_thread(ThreadPlacement &placement, const std::string &role, size_t index) {
+    std::string name = role + std::to_string(index);
+    int cpu = placement.pinNext();
+    // Named for top -H; not the main thread, whose name is the process's
+    if (currentThreadId() != getpid()) {
+        pthread_setname_np(pthread_self(), ("gc-" + name).substr(0, 15).c_str());
+    }
+    PerformanceMetrics::getInstance().registerThread(name, cpu);
+}
 
 void ChatServer::setup_socket() {
     server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd == -1) {
-        perror("socket");
+        LOG_ERROR("socket_failed", "error", std::strerror(errno));
         std::exit(EXIT_FAILURE);
     }
 
     int opt = 1;
     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (bus) {
+        // Every process on the bus listens on the same port; the kernel
+        // spreads incoming connections across them
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    }
 
     sockaddr_in addr{};
     addr.sin_family      = AF_INET;
@@ -25,21 +132,40 @@ void ChatServer::setup_socket() {
     addr.sin_port        = htons(port);
 
     if (bind(server_fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
-        perror("bind");
+        LOG_ERROR("bind_failed", "port", port, "error", std::strerror(errno));
         std::exit(EXIT_FAILURE);
     }
-    if (listen(server_fd, 8) < 0) {
-        perror("listen");
+    // Room for a burst of connects, e.g. a fleet of bots starting together
+    if (listen(server_fd, SOMAXCONN) < 0) {
+        LOG_ERROR("listen_failed", "port", port, "error", std::strerror(errno));
         std::exit(EXIT_FAILURE);
     }
 
-    std::cout << "Server listening on port " << port << std::endl;
+    LOG_INFO("listening", "port", port);
+}
+
+void ChatServer::load_snapshot() {
+    auto started = std::chrono::steady_clock::now();
+    size_t restored = groups.cacheManager().loadSnapshot(snapshotPath);
+    if (restored == 0) return;
+
+    auto took = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    LOG_INFO("snapshot_restored", "messages", restored, "ms", took / 1000.0);
 }
 
 void ChatServer::run() {
+    load_snapshot();
+    if (cluster) cluster->start();
+    if (bus) {
+        busReader = std::thread(&ChatServer::bus_loop, this);
+        LOG_INFO("bus_attached", "member", bus->memberID());
+    }
     setup_socket();
+    // After every other thread is started, so none inherits this mask
+    place_thread(ioPlacement, "accept", 0);
 
-    while (true) {
+    while (!stopping.load()) {
         sockaddr_in client_addr{};
         socklen_t addrlen = sizeof(client_addr);
         int clientSocket = accept(server_fd,
@@ -47,96 +173,522 @@ void ChatServer::run() {
                                   &addrlen);
 
         if (clientSocket < 0) {
-            perror("accept");
+            if (stopping.load()) break;
+            LOG_WARN("accept_failed", "error", std::strerror(errno));
             continue;
         }
 
-        std::cout << "New client " << clientSocket << " connected\n";
+        LOG_INFO("client_connected", "fd", clientSocket,
+                 "addr", inet_ntoa(client_addr.sin_addr),
+                 "port", ntohs(client_addr.sin_port));
+        {
+            // Tracked from accept so connections still queued for a
+            // worker are drained too
+            std::lock_guard<std::mutex> lock(clientsMtx);
+            clients.insert(clientSocket);
+        }
 
-        pool.enqueue([this, clientSocket]() {
-            handle_client(clientSocket);
-        });
+        // The wait for a free worker is not message latency: a worker
+        // is held for a whole connection, so it is not fed to admission
+        pool.enqueue([this, clientSocket]() { handle_client(clientSocket); });
+    }
+}
+
+bool ChatServer::admit_text(TokenBucket &clientBucket, uint16_t groupID) {
+    auto &metrics = PerformanceMetrics::getInstance();
+
+    if (!clientBucket.tryConsume()) {
+        metrics.incrementClientThrottled();
+        return false;
+    }
+    if (!limiter.allowGroup(groupID)) {
+        metrics.incrementGroupThrottled();
+        return false;
+    }
+
+    switch (admission.admit()) {
+        case AdmissionController::SHED:
+            metrics.incrementAdmissionShed();
+            return false;
+        case AdmissionController::DELAY:
+            // Stall this connection's reader so TCP pushes back on the sender
+            metrics.incrementAdmissionDelayed();
+            std::this_thread::sleep_for(admission.delayFor());
+            return true;
+        default:
+            return true;
     }
 }
 
 void ChatServer::handle_client(int clientSocket) {
-    groups.joinGroup(clientSocket, 1); // default group
-    uint16_t currentGroup = 1;
+    if (!stopping.load()) {
+        serve_client(clientSocket);
+    }
 
-    // Send recent message history for group 1
-    auto history = groups.getGroupHistory(1);
-    for (const auto &msg : history) {
-        ChatPacket netPkt = to_network(msg);
-        send(clientSocket, &netPkt, sizeof(netPkt), 0);
+    {
+        std::lock_guard<std::mutex> lock(clientsMtx);
+        clients.erase(clientSocket);
     }
+    clientsCv.notify_all();
+    close(clientSocket);
+}
+
+void ChatServer::append_history(std::vector<unsigned char> &out, uint16_t groupID) {
+    appendWire(out, groups.getGroupHistory(groupID));
+}
+
+void ChatServer::send_history(int clientSocket, uint16_t groupID, uint32_t since,
+                              uint16_t epoch) {
+    // Processes on a bus each number a group's messages themselves, and
+    // a reconnect may land on a different one, so `since` can't be
+    // trusted: send everything held, marked as a gap
+    bool foreign = bus && since != 0;
+    auto delta = groups.getGroupHistorySince(groupID, foreign ? 0 : since, epoch);
+    if (foreign) delta.gap = true;
+    PerformanceMetrics::getInstance().recordHistorySync(delta.messages.size(), since != 0, delta.gap);
+
+    // One send for the whole history, so a switch is a single write
+    std::vector<unsigned char> out;
+    if (delta.gap) {
+        uint32_t next = delta.messages.empty() ? delta.last + 1 : delta.messages.front().seq;
+        appendWire(out, {make_packet(MSG_HISTORY_GAP, groupID,
+                                     std::to_string(since) + " " + std::to_string(next),
+                                     0, "SERVER")});
+    }
+    appendWire(out, delta.messages);
+    if (out.empty()) return;
+    groups.sendTo(clientSocket, out.data(), out.size());
+}
+
+template <MessageType Type, ChatServer::Handler H>
+bool ChatServer::route(ClientSession &session, const unsigned char *wire) {
+    ChatPacket pkt;
+    Wire::MessageLayout<Type>::type::decode(wire, pkt);
+    pkt.senderID = session.socket; // Set sender ID to socket
+
+    LOG_PACKET("packet", "fd", session.socket, "type", pkt.type,
+               "group", pkt.groupID, "from", fixedField(pkt.senderName),
+               "payload", fixedField(pkt.payload));
+    return (this->*H)(session, pkt);
+}
+
+constexpr ChatServer::DispatchTable ChatServer::make_dispatch_table() {
+    DispatchTable table{};
+    for (auto &slot : table) slot = &ChatServer::on_unknown;
+
+    table[MSG_JOIN]        = &ChatServer::route<MSG_JOIN, &ChatServer::on_switch_group>;
+    table[MSG_SWITCH]      = &ChatServer::route<MSG_SWITCH, &ChatServer::on_switch_group>;
+    table[MSG_TEXT]        = &ChatServer::route<MSG_TEXT, &ChatServer::on_text>;
+    table[MSG_LIST_GROUPS] = &ChatServer::route<MSG_LIST_GROUPS, &ChatServer::on_list_groups>;
+    table[MSG_AUDIO_JOIN]  = &ChatServer::route<MSG_AUDIO_JOIN, &ChatServer::on_audio_join>;
+    table[MSG_SEARCH]      = &ChatServer::route<MSG_SEARCH, &ChatServer::on_search>;
+    table[MSG_FIND]        = &ChatServer::route<MSG_FIND, &ChatServer::on_search>;
+    table[MSG_SUBSCRIBE]   = &ChatServer::route<MSG_SUBSCRIBE, &ChatServer::on_subscribe>;
+    table[MSG_UNSUBSCRIBE] = &ChatServer::route<MSG_UNSUBSCRIBE, &ChatServer::on_subscribe>;
+    table[MSG_TOP]         = &ChatServer::route<MSG_TOP, &ChatServer::on_top>;
+    table[MSG_ATTACH_OFFER] = &ChatServer::route<MSG_ATTACH_OFFER, &ChatServer::on_attach_offer>;
+    table[MSG_ATTACH_CHUNK] = &ChatServer::route<MSG_ATTACH_CHUNK, &ChatServer::on_attach_chunk>;
+    table[MSG_ATTACH_GET]   = &ChatServer::route<MSG_ATTACH_GET, &ChatServer::on_attach_get>;
+    // MSG_SEARCH_DONE, MSG_ATTACH_DATA, MSG_ATTACHMENT and MSG_HISTORY_GAP
+    // are server -> client only
+    return table;
+}
 
+void ChatServer::serve_client(int clientSocket) {
+    static constexpr DispatchTable dispatch = make_dispatch_table();
+    static_assert(dispatch[MSG_SEARCH_DONE] == &ChatServer::on_unknown &&
+                  dispatch[MSG_ATTACH_DATA] == &ChatServer::on_unknown &&
+                  dispatch[MSG_ATTACHMENT] == &ChatServer::on_unknown &&
+                  dispatch[MSG_HISTORY_GAP] == &ChatServer::on_unknown,
+                  "reply-only types are not accepted from clients");
+
+    // Replies to control requests go out at once rather than waiting
+    // behind Nagle for the client's delayed ACK
+    int one = 1;
+    setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // Session, receive buffer and group member are allocated here, on
+    // the (possibly pinned) worker that serves the connection, so they
+    // live on that worker's NUMA node
+    ClientSession session{clientSocket, 1, TokenBucket(CLIENT_RATE, CLIENT_BURST)};
+    groups.joinGroup(clientSocket, 1); // default group
+    // History waits for the client's JOIN, which says what it has
+    // already seen
+
+    auto &metrics = PerformanceMetrics::getInstance();
+    RecvBuffer in(Wire::PACKET_SIZE);
+    session.in = &in;
     while (true) {
-        ChatPacket netPkt{};
-        ssize_t bytes = recv(clientSocket, &netPkt, sizeof(netPkt), 0);
-
-        if (bytes <= 0) {
-            std::cout << "Client " << clientSocket << " disconnected\n";
-            groups.removeClient(clientSocket);
-            close(clientSocket);
-            return;
+        // One syscall per burst; every whole packet in it is handled
+        // before the next recv, a trailing partial one waits for the rest
+        if (in.fill(clientSocket) <= 0) {
+            LOG_INFO("client_disconnected", "fd", clientSocket,
+                     "partial_bytes", in.pending());
+            break;
         }
 
-        ChatPacket pkt = to_host(netPkt);
-        pkt.senderID = clientSocket; // Set sender ID to socket
-
-        std::cout << "[SERVER] Received type=" << (int)pkt.type
-                  << " group=" << pkt.groupID
-                  << " from=" << pkt.senderName
-                  << " payload=" << pkt.payload << "\n";
-
-        switch (pkt.type) {
-            case MSG_JOIN:
-            case MSG_SWITCH:
-                currentGroup = pkt.groupID;
-                groups.switchGroup(clientSocket, currentGroup);
-                // Send history for new group
-                {
-                    auto hist = groups.getGroupHistory(currentGroup);
-                    for (const auto &msg : hist) {
-                        ChatPacket net = to_network(msg);
-                        send(clientSocket, &net, sizeof(net), 0);
-                    }
-                }
-                break;
-
-            case MSG_TEXT:
-                groups.broadcast(clientSocket, currentGroup, pkt);
-                PerformanceMetrics::getInstance().incrementMessageCount();
-                break;
-
-            case MSG_LIST_GROUPS:
-                {
-                    auto activeGroups = groups.getActiveGroups();
-                    std::string groupList;
-                    for (size_t i = 0; i < activeGroups.size(); ++i) {
-                        groupList += std::to_string(activeGroups[i]);
-                        if (i < activeGroups.size() - 1) groupList += ", ";
-                    }
-                    ChatPacket resp = make_packet(MSG_LIST_GROUPS, 0, groupList, 0, "SERVER");
-                    ChatPacket net = to_network(resp);
-                    send(clientSocket, &net, sizeof(net), 0);
-                }
-                break;
-
-            default:
-                std::cout << "Unknown packet type\n";
-        }
+        bool keep = true;
+        size_t decoded = in.drain([&](const unsigned char *wire) {
+            auto arrived = std::chrono::steady_clock::now();
+            keep = (this->*dispatch[wire[0]])(session, wire);
+            if (is_control(wire[0])) {
+                metrics.recordControlLatency(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - arrived).count());
+            }
+            return keep;
+        });
+        metrics.recordRecv(decoded);
+        if (!keep) break;
     }
+    groups.removeClient(clientSocket);
+    // A half-sent upload resumes from its last whole chunk
+    attachments.abandon(clientSocket);
+}
+
+bool ChatServer::on_switch_group(ClientSession &session, ChatPacket &pkt) {
+    session.currentGroup = pkt.groupID;
+    groups.switchGroup(session.socket, session.currentGroup);
+    // History after the last message the client says it has (pkt.seq
+    // of pkt.epoch)
+    send_history(session.socket, session.currentGroup, pkt.seq, pkt.epoch);
+    return true;
+}
+
+bool ChatServer::on_text(ClientSession &session, ChatPacket &pkt) {
+    if (!admit_text(session.bucket, session.currentGroup)) return true;
+
+    // The group is fixed here, so a later switch cannot redirect it
+    if (!bulk.submit({session.socket, session.currentGroup, pkt,
+                      std::chrono::steady_clock::now()}))
+        PerformanceMetrics::getInstance().incrementBulkShed();
+    return true;
+}
+
+// Runs on a bulk lane worker
+void ChatServer::deliver_text(const BulkJob &job) {
+    auto &metrics = PerformanceMetrics::getInstance();
+    auto started = std::chrono::steady_clock::now();
+    metrics.recordBulkQueueWait(std::chrono::duration_cast<std::chrono::microseconds>(
+        started - job.queued).count());
+
+    if (cluster) {
+        cluster->publish(job.senderSocket, job.groupID, job.pkt);
+    } else {
+        groups.broadcast(job.senderSocket, job.groupID, job.pkt);
+        if (bus) publish_bus(job.senderSocket, job.groupID, job.pkt);
+    }
+    metrics.incrementMessageCount();
+
+    // Queueing plus fan-out (blocking sends into full socket buffers)
+    // is the latency members see behind other senders
+    admission.observe(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - job.queued).count());
+}
+
+bool ChatServer::on_audio_join(ClientSession &session, ChatPacket &pkt) {
+    // From here on this connection carries audio frames only.
+    // The echoed JOIN tells the client no more ChatPackets follow; it
+    // sends no audio before that, so nothing is left in the recv buffer.
+    // The ack goes out while still a chat member, serialized with any
+    // broadcast in flight to this socket
+    unsigned char ack[Wire::PACKET_SIZE];
+    Wire::encode(make_packet(MSG_AUDIO_JOIN, pkt.groupID, "", 0, "SERVER"), ack);
+    bool acked = groups.sendTo(session.socket, ack, sizeof(ack));
+    groups.removeClient(session.socket);
+    if (!acked) return false;
+    LOG_INFO("audio_stream_started", "fd", session.socket, "group", pkt.groupID);
+    audio.serve(session.socket, pkt.groupID);
+    LOG_INFO("audio_stream_ended", "fd", session.socket);
+    return false;
+}
+
+bool ChatServer::on_search(ClientSession &session, ChatPacket &pkt) {
+    uint16_t target = pkt.groupID ? pkt.groupID : session.currentGroup;
+    std::string query(pkt.payload, strnlen(pkt.payload, sizeof(pkt.payload)));
+    HistorySearch search(groups, session.socket);
+    if (pkt.type == MSG_FIND) {
+        search.runIndexed(target, query);
+    } else {
+        search.run(target, query);
+    }
+    return true;
+}
+
+bool ChatServer::on_subscribe(ClientSession &session, ChatPacket &pkt) {
+    std::vector<uint16_t> wanted;
+    std::istringstream ids(payloadText(pkt));
+    for (std::string id; std::getline(ids >> std::ws, id, ' ');) {
+        char *end = nullptr;
+        unsigned long g = std::strtoul(id.c_str(), &end, 10);
+        if (end != id.c_str() && g <= UINT16_MAX) wanted.push_back(static_cast<uint16_t>(g));
+    }
+    if (wanted.empty()) wanted.push_back(pkt.groupID);
+
+    // History for every newly received group and the updated group list
+    // go out as one write
+    std::vector<unsigned char> out;
+    if (pkt.type == MSG_SUBSCRIBE) {
+        for (uint16_t g : groups.subscribe(session.socket, wanted)) append_history(out, g);
+    } else {
+        groups.unsubscribe(session.socket, wanted);
+    }
+
+    std::string receiving;
+    for (uint16_t g : groups.groupsOf(session.socket)) {
+        if (!receiving.empty()) receiving += " ";
+        receiving += std::to_string(g);
+    }
+    unsigned char wire[Wire::PACKET_SIZE];
+    Wire::encode(make_packet(static_cast<MessageType>(pkt.type), session.currentGroup,
+                             receiving, 0, "SERVER"), wire);
+    out.insert(out.end(), wire, wire + sizeof(wire));
+    groups.sendTo(session.socket, out.data(), out.size());
+    return true;
+}
+
+bool ChatServer::on_top(ClientSession &session, ChatPacket &) {
+    auto &metrics = PerformanceMetrics::getInstance();
+    char rate[32];
+    auto perSecond = [&rate](double r) {
+        std::snprintf(rate, sizeof(rate), "%.2f", r);
+        return std::string(rate);
+    };
+
+    // Rates over the recent, decaying window of the sketches
+    std::string lines[] = {
+        topLine("groups msg/s", metrics.topGroups(TOP_REPLIED), [&](const auto &e) {
+            return std::to_string(e.key) + " " + perSecond(e.rate);
+        }),
+        topLine("senders bytes/s", metrics.topSenders(TOP_REPLIED), [&](const auto &e) {
+            return e.key + " " + perSecond(e.rate);
+        }),
+        topLine("fan-out bytes/s", metrics.topFanout(TOP_REPLIED), [&](const auto &e) {
+            return std::to_string(e.key) + " " + perSecond(e.rate);
+        }),
+    };
+
+    std::vector<unsigned char> out;
+    unsigned char wire[Wire::PACKET_SIZE];
+    for (const auto &line : lines) {
+        Wire::encode(make_packet(MSG_TOP, 0, line, 0, "SERVER"), wire);
+        out.insert(out.end(), wire, wire + sizeof(wire));
+    }
+    groups.sendTo(session.socket, out.data(), out.size());
+    return true;
+}
+
+bool ChatServer::on_list_groups(ClientSession &session, ChatPacket &) {
+    auto activeGroups = groups.getActiveGroups();
+    std::string groupList;
+    for (size_t i = 0; i < activeGroups.size(); ++i) {
+        groupList += std::to_string(activeGroups[i]);
+        if (i < activeGroups.size() - 1) groupList += ", ";
+    }
+    unsigned char wire[Wire::PACKET_SIZE];
+    Wire::encode(make_packet(MSG_LIST_GROUPS, 0, groupList, 0, "SERVER"), wire);
+    groups.sendTo(session.socket, wire, sizeof(wire));
+    return true;
+}
+
+void ChatServer::reply(int clientSocket, MessageType type, const std::string &text) {
+    unsigned char wire[Wire::PACKET_SIZE];
+    Wire::encode(make_packet(type, 0, text, 0, "SERVER"), wire);
+    groups.sendTo(clientSocket, wire, sizeof(wire));
+}
+
+bool ChatServer::on_attach_offer(ClientSession &session, ChatPacket &pkt) {
+    std::istringstream fields(payloadText(pkt));
+    PendingAttachment offer;
+    fields >> offer.hash >> offer.size;
+    std::getline(fields >> std::ws, offer.name);
+    offer.sender  = std::string(fixedField(pkt.senderName));
+    offer.groupID = session.currentGroup;
+
+    int64_t stored = fields ? attachments.begin(offer.hash, offer.size, session.socket) : -1;
+    if (stored < 0) {
+        reply(session.socket, MSG_ATTACH_OFFER, "ERR cannot accept " + offer.hash);
+        return true;
+    }
+    session.upload = std::move(offer);
+    reply(session.socket, MSG_ATTACH_OFFER,
+          session.upload.hash + " " + std::to_string(stored));
+    // Same content uploaded before: nothing to send, just link it
+    if (static_cast<uint64_t>(stored) == session.upload.size) announce_attachment(session);
+    return true;
+}
+
+bool ChatServer::on_attach_chunk(ClientSession &session, ChatPacket &pkt) {
+    std::istringstream fields(payloadText(pkt));
+    std::string hash;
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    fields >> hash >> offset >> length;
+    // Without a usable length the body cannot be skipped; give up on
+    // the connection rather than decode file bytes as packets
+    if (!fields || length > MAX_ATTACH_CHUNK) {
+        LOG_WARN("attach_bad_chunk", "fd", session.socket, "header", payloadText(pkt));
+        return false;
+    }
+
+    switch (attachments.receive(hash, offset, length, session.socket,
+                                *session.in, session.socket)) {
+        case AttachmentStore::Chunk::STORED:
+            return true;
+        case AttachmentStore::Chunk::COMPLETE:
+            LOG_INFO("attachment_stored", "fd", session.socket, "hash", hash,
+                     "bytes", offset + length);
+            reply(session.socket, MSG_ATTACH_OFFER, hash + " " + std::to_string(offset + length));
+            if (session.upload.hash == hash) announce_attachment(session);
+            return true;
+        case AttachmentStore::Chunk::REJECTED:
+            reply(session.socket, MSG_ATTACH_OFFER, "ERR unexpected chunk " + hash);
+            return true;
+        case AttachmentStore::Chunk::CORRUPT:
+            LOG_WARN("attachment_corrupt", "fd", session.socket, "hash", hash);
+            reply(session.socket, MSG_ATTACH_OFFER, "ERR hash mismatch " + hash);
+            return true;
+        case AttachmentStore::Chunk::LOST:
+        default:
+            LOG_WARN("attach_upload_lost", "fd", session.socket, "hash", hash);
+            return false;
+    }
+}
+
+// Linked like a text message: logged, cached for history and fanned out
+// on the bulk lane, so it reaches members in order with their chat
+void ChatServer::announce_attachment(ClientSession &session) {
+    const PendingAttachment &up = session.upload;
+    ChatPacket pkt = make_packet(MSG_ATTACHMENT, up.groupID,
+                                 up.hash + " " + std::to_string(up.size) + " " + up.name,
+                                 static_cast<uint16_t>(session.socket), up.sender);
+    if (!bulk.submit({session.socket, up.groupID, pkt, std::chrono::steady_clock::now()})) {
+        // Stored either way; offering it again links it without a re-upload
+        PerformanceMetrics::getInstance().incrementBulkShed();
+        reply(session.socket, MSG_ATTACH_OFFER, "ERR busy " + up.hash);
+    }
+    session.upload = PendingAttachment();
+}
+
+bool ChatServer::on_attach_get(ClientSession &session, ChatPacket &pkt) {
+    std::istringstream fields(payloadText(pkt));
+    std::string hash;
+    uint64_t offset = 0, length = 0;
+    fields >> hash >> offset >> length;
+
+    uint64_t size = 0;
+    int fd = fields ? attachments.open(hash, size) : -1;
+    if (fd < 0 || offset > size) {
+        if (fd >= 0) close(fd);
+        reply(session.socket, MSG_ATTACH_DATA, "ERR no such attachment " + hash);
+        return true;
+    }
+
+    // One chunk per request; the client asks for the next when this one
+    // is in, so a download never holds the socket for long
+    uint64_t len = std::min<uint64_t>({length ? length : MAX_ATTACH_CHUNK,
+                                       MAX_ATTACH_CHUNK, size - offset});
+    unsigned char header[Wire::PACKET_SIZE];
+    Wire::encode(make_packet(MSG_ATTACH_DATA, 0,
+                             hash + " " + std::to_string(offset) + " " +
+                             std::to_string(len) + " " + std::to_string(size),
+                             0, "SERVER"), header);
+    bool sent = groups.sendFile(session.socket, header, sizeof(header), fd, offset, len);
+    close(fd);
+    if (!sent) LOG_WARN("attach_send_failed", "fd", session.socket, "hash", hash);
+    return sent;
+}
+
+bool ChatServer::on_unknown(ClientSession &session, const unsigned char *wire) {
+    PerformanceMetrics::getInstance().incrementUnknownPacket();
+    LOG_WARN("unknown_packet", "fd", session.socket, "type", wire[0]);
+    return true;
+}
+
+void ChatServer::publish_bus(int clientSocket, uint16_t groupID, const ChatPacket &pkt) {
+    if (bus->publish(groupID, clientSocket, &pkt, sizeof(pkt))) {
+        PerformanceMetrics::getInstance().incrementBusPublished();
+    }
+}
+
+// Messages other processes on this host received from their clients
+void ChatServer::bus_loop() {
+    auto deliver = [this](const BusMessage &msg) {
+        if (msg.length != sizeof(ChatPacket)) return;
+        ChatPacket pkt;
+        std::memcpy(&pkt, msg.data, sizeof(pkt));
+        // Bus members number messages independently (see send_history)
+        pkt.seq = 0;
+        groups.relay(-1, msg.groupID, pkt);
+        PerformanceMetrics::getInstance().incrementBusReceived();
+    };
+    while (!stopping.load()) {
+        bus->poll(deliver, 100);
+    }
+}
+
+void ChatServer::requestStop() {
+    stopping.store(true);
+    // Wakes the blocked accept(); the fd itself is closed in shutdown()
+    if (server_fd != -1) {
+        ::shutdown(server_fd, SHUT_RDWR);
+    }
+}
+
+void ChatServer::drain_clients() {
+    std::unique_lock<std::mutex> lock(clientsMtx);
+
+    // Half-close: readers see EOF and finish the packet they are on,
+    // while anything already queued for sending still goes out
+    for (int sock : clients) {
+        ::shutdown(sock, SHUT_RD);
+    }
+    if (clientsCv.wait_for(lock, DRAIN_TIMEOUT, [this] { return clients.empty(); }))
+        return;
+
+    // Stuck in send() to a peer that stopped reading; cut it off
+    LOG_WARN("drain_timeout", "connections", clients.size());
+    for (int sock : clients) {
+        ::shutdown(sock, SHUT_RDWR);
+    }
+    clientsCv.wait_for(lock, DRAIN_TIMEOUT, [this] { return clients.empty(); });
 }
 
 void ChatServer::shutdown() {
-    std::cout << "Shutting down server...\n";
-    
-    // Log final performance metrics
-    PerformanceMetrics::getInstance().logMetrics();
-    
+    if (shutDown) return;
+    shutDown = true;
+
+    LOG_INFO("shutdown_started");
+    requestStop();
+
     if (server_fd != -1) {
         close(server_fd);
+        server_fd = -1;
+    }
+
+    audio.flushAll();
+    drain_clients();
+    // Fan out texts the readers queued before they exited
+    bulk.stop();
+    // After the drain so late client messages still reach their owners;
+    // peers rebalance our groups once the links drop
+    if (cluster) cluster->stop();
+    if (busReader.joinable()) {
+        busReader.join();
+        PerformanceMetrics::getInstance().addBusLost(bus->lost());
+    }
+    groups.searchIndex().flush();
+
+    auto started = std::chrono::steady_clock::now();
+    if (groups.cacheManager().saveSnapshot(snapshotPath)) {
+        auto took = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started).count();
+        LOG_INFO("snapshot_written", "ms", took / 1000.0);
+    } else {
+        LOG_ERROR("snapshot_failed", "path", snapshotPath);
     }
-    std::cout << "Server shutdown complete.\n";
+
+    // Log final performance metrics
+    PerformanceMetrics::getInstance().logMetrics();
+    LOG_INFO("shutdown_complete", "log_dropped", Logger::instance().dropped());
+    Logger::instance().flush();
 }
@@ -2,23 +2,144 @@
 
 #include "thread_pool.h"
 #include "group_manager.h"
+#include "rate_limiter.h"
+#include "audio_relay.h"
+#include "cluster.h"
+#include "bulk_lane.h"
+#include "attachment_store.h"
+#include "shared/shm_bus.h"
 #include "shared/protocol.h"
+#include "shared/wire.h"
+#include "shared/recv_buffer.h"
 #include "shared/virtual_memory.h"
+#include "shared/cpu_topology.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// The attachment a connection last offered; announced to its group
+// once the store holds all of it
+struct PendingAttachment {
+    std::string hash;
+    uint64_t size = 0;
+    std::string name;
+    std::string sender;
+    uint16_t groupID = 0;
+};
+
+// Per-connection state handed to every message handler
+struct ClientSession {
+    int socket;
+    uint16_t currentGroup;
+    TokenBucket bucket;
+    RecvBuffer *in = nullptr;  // for types followed by a raw body
+    PendingAttachment upload{};
+};
 
 class ChatServer {
 public:
-    ChatServer(int port, size_t numThreads);
+    // busName joins the shared memory bus of that name (same host only).
+    // Groups of at least fanoutThreshold members are broadcast in parallel.
+    // affinity pins pool workers and I/O threads to CPUs.
+    ChatServer(int port, size_t numThreads,
+               const ClusterConfig &clusterConfig = ClusterConfig(),
+               const std::string &busName = "",
+               size_t fanoutThreshold = FanoutExecutor::DEFAULT_THRESHOLD,
+               const AffinityConfig &affinity = AffinityConfig());
 
     void run();
+
+    // Async-signal-safe: stop accepting and make run() return
+    void requestStop();
+
+    // Drain: stop accepting, let connections finish, flush the index and
+    // snapshot every group cache. Call after run() has returned.
     void shutdown();
 
 private:
     int port;
     int server_fd;
+    std::unique_ptr<ShmBus> bus;  // null unless --bus
+    std::string snapshotPath;     // per node/bus member
+    // Before the thread owners below: their threads pin themselves
+    ThreadPlacement workerPlacement;  // pool workers
+    ThreadPlacement ioPlacement;      // accept loop, bulk lane, fan-out helpers
     ThreadPool pool;
     GroupManager groups;
+    AttachmentStore attachments;  // content-addressed uploads
     VirtualMemory vmem;  // Virtual memory simulator
+    RateLimiter limiter;          // per-group token buckets
+    AdmissionController admission; // server-wide load shedding
+    AudioRelay audio;             // per-group audio streams
+    std::unique_ptr<Cluster> cluster;  // null when standalone
+    std::thread busReader;
+    BulkLane bulk;                // text fan-out, off the reader threads
 
+    static constexpr double CLIENT_RATE  = 20.0;  // msgs/sec per connection
+    static constexpr double CLIENT_BURST = 40.0;
+    static constexpr size_t BULK_SHARDS  = 4;     // fan-out workers
+    static constexpr size_t BULK_DEPTH   = 1024;  // queued texts per worker
+    static constexpr size_t TOP_REPLIED  = 10;    // entries per MSG_TOP list
+    static constexpr std::chrono::seconds DRAIN_TIMEOUT{2};
+
+    // Open connections, so shutdown() can drain them
+    std::mutex clientsMtx;
+    std::condition_variable clientsCv;
+    std::unordered_set<int> clients;
+    std::atomic<bool> stopping{false};
+    bool shutDown = false;
+
+    void place_thread(ThreadPlacement &placement, const std::string &role, size_t index);
     void setup_socket();
+    void load_snapshot();
+    void drain_clients();
+    void bus_loop();
+    void publish_bus(int clientSocket, uint16_t groupID, const ChatPacket &pkt);
     void handle_client(int clientSocket);
+    void serve_client(int clientSocket);
+    bool admit_text(TokenBucket &clientBucket, uint16_t groupID);
+    void append_history(std::vector<unsigned char> &out, uint16_t groupID);
+    // Only what follows `since`, or a MSG_HISTORY_GAP and all there is
+    void send_history(int clientSocket, uint16_t groupID, uint32_t since, uint16_t epoch);
+    void deliver_text(const BulkJob &job);
+    void announce_attachment(ClientSession &session);
+    void reply(int clientSocket, MessageType type, const std::string &text);
+
+    // Control-plane types are answered on the reader thread as soon as
+    // they arrive and timed separately; bulk text goes to the BulkLane
+    static constexpr bool is_control(uint8_t type) {
+        return type == MSG_JOIN || type == MSG_SWITCH || type == MSG_LIST_GROUPS ||
+               type == MSG_SUBSCRIBE || type == MSG_UNSUBSCRIBE || type == MSG_TOP;
+    }
+
+    // Message dispatch: one table slot per type byte, filled at compile
+    // time. Each slot decodes with that type's wire layout and calls its
+    // handler. Handlers return false once the connection stops carrying
+    // chat packets.
+    using Route = bool (ChatServer::*)(ClientSession &, const unsigned char *);
+    using Handler = bool (ChatServer::*)(ClientSession &, ChatPacket &);
+    using DispatchTable = std::array<Route, 256>;
+
+    template <MessageType Type, Handler H>
+    bool route(ClientSession &session, const unsigned char *wire);
+    static constexpr DispatchTable make_dispatch_table();
+
+    bool on_switch_group(ClientSession &session, ChatPacket &pkt);
+    bool on_text(ClientSession &session, ChatPacket &pkt);
+    bool on_audio_join(ClientSession &session, ChatPacket &pkt);
+    bool on_search(ClientSession &session, ChatPacket &pkt);
+    bool on_list_groups(ClientSession &session, ChatPacket &pkt);
+    bool on_subscribe(ClientSession &session, ChatPacket &pkt);
+    bool on_top(ClientSession &session, ChatPacket &pkt);
+    bool on_attach_offer(ClientSession &session, ChatPacket &pkt);
+    bool on_attach_chunk(ClientSession &session, ChatPacket &pkt);
+    bool on_attach_get(ClientSession &session, ChatPacket &pkt);
+    bool on_unknown(ClientSession &session, const unsigned char *wire);
 };
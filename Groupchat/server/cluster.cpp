@@ -0,0 +1,472 @@
+// server/cluster.cpp
+#include "cluster.h"
+#include "shared/logger.h"
+#include "shared/metrics.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+bool recvExact(int fd, void *buf, size_t len) {
+    char *p = static_cast<char*>(buf);
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool sendExact(int fd, const void *buf, size_t len) {
+    const char *p = static_cast<const char*>(buf);
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+PeerFrame makeFrame(PeerMessage kind, uint16_t nodeID, uint32_t originSocket,
+                    const ChatPacket &hostPkt) {
+    PeerFrame f{};
+    f.kind         = kind;
+    f.nodeID       = htons(nodeID);
+    f.originSocket = htonl(originSocket);
+    f.packet       = to_network(hostPkt);
+    return f;
+}
+
+} // namespace
+
+bool ClusterConfig::parsePeers(const std::string &spec, std::vector<PeerAddress> &out) {
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        std::string item = spec.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) continue;
+
+        size_t at = item.find('@');
+        size_t colon = item.rfind(':');
+        if (at == std::string::npos || colon == std::string::npos || colon < at)
+            return false;
+        try {
+            PeerAddress p;
+            p.nodeID = static_cast<uint16_t>(std::stoul(item.substr(0, at)));
+            p.host   = item.substr(at + 1, colon - at - 1);
+            p.port   = static_cast<uint16_t>(std::stoul(item.substr(colon + 1)));
+            if (p.nodeID == 0 || p.host.empty()) return false;
+            out.push_back(p);
+        } catch (const std::exception &) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Cluster::Cluster(const ClusterConfig &config, GroupManager &groups)
+    : config(config), groups(groups) {
+    ring.addNode(config.nodeID);
+    for (const auto &p : config.peers) {
+        if (p.nodeID == config.nodeID) continue;
+        auto link = std::make_unique<Link>();
+        link->addr = p;
+        links.push_back(std::move(link));
+    }
+}
+
+Cluster::~Cluster() {
+    stop();
+}
+
+void Cluster::start() {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port        = htons(config.clusterPort);
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 16) < 0) {
+        LOG_ERROR("cluster_listen_failed", "port", config.clusterPort,
+                  "error", std::strerror(errno));
+        close(listenFd);
+        listenFd = -1;
+        return;
+    }
+
+    running.store(true);
+    for (auto &link : links) {
+        link->writer = std::thread(&Cluster::writerLoop, this, std::ref(*link));
+    }
+    listener = std::thread(&Cluster::listenLoop, this);
+    dialer = std::thread(&Cluster::dialLoop, this);
+    LOG_INFO("cluster_started", "node", config.nodeID,
+             "port", config.clusterPort, "peers", links.size());
+}
+
+void Cluster::stop() {
+    if (!running.exchange(false)) return;
+
+    ::shutdown(listenFd, SHUT_RDWR);
+    if (listener.joinable()) listener.join();
+    if (dialer.joinable()) dialer.join();
+    close(listenFd);
+    listenFd = -1;
+
+    for (auto &link : links) {
+        link->cv.notify_all();
+        if (link->writer.joinable()) link->writer.join();
+        std::lock_guard<std::mutex> lock(link->mtx);
+        for (int fd : link->stale) close(fd);
+        link->stale.clear();
+        if (link->fd >= 0) {
+            close(link->fd);
+            link->fd = -1;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(inboundMtx);
+        for (int fd : inboundFds) ::shutdown(fd, SHUT_RDWR);
+    }
+    for (auto &t : inboundThreads) {
+        if (t.joinable()) t.join();
+    }
+}
+
+uint16_t Cluster::owner(uint16_t groupID) {
+    std::lock_guard<std::mutex> lock(ringMtx);
+    return ring.owner(groupID);
+}
+
+// ===== Message routing =====
+
+void Cluster::publish(int senderSocket, uint16_t groupID, const ChatPacket &pkt) {
+    // A failed forward takes the owner out of the ring, so the retry
+    // goes to the group's new owner (eventually this node)
+    for (size_t attempt = 0; attempt <= links.size(); ++attempt) {
+        uint16_t target = owner(groupID);
+        if (target == config.nodeID) {
+            ownerPublish(config.nodeID, senderSocket, groupID, pkt);
+            return;
+        }
+        PeerFrame f = makeFrame(PEER_FORWARD, config.nodeID, senderSocket, pkt);
+        if (sendTo(target, f)) {
+            PerformanceMetrics::getInstance().incrementClusterForwarded();
+            return;
+        }
+    }
+    ownerPublish(config.nodeID, senderSocket, groupID, pkt);
+}
+
+void Cluster::ownerPublish(uint16_t originNode, uint32_t originSocket,
+                           uint16_t groupID, const ChatPacket &pkt) {
+    std::lock_guard<std::mutex> lock(publishMtx[groupID % PUBLISH_STRIPES]);
+
+    int skip = originNode == config.nodeID ? static_cast<int>(originSocket) : -1;
+    // The owner numbers the message once; peers keep its number, so a
+    // client can rejoin on any node with the last sequence it saw
+    ChatPacket stamped = groups.broadcast(skip, groupID, pkt);
+
+    PeerFrame f = makeFrame(PEER_DELIVER, originNode, originSocket, stamped);
+    for (auto &link : links) {
+        if (sendTo(link->addr.nodeID, f))
+            PerformanceMetrics::getInstance().incrementClusterDelivered();
+    }
+}
+
+void Cluster::handleFrame(const PeerFrame &f) {
+    uint16_t origin = ntohs(f.nodeID);
+    uint32_t originSocket = ntohl(f.originSocket);
+    ChatPacket pkt = to_host(f.packet);
+
+    switch (f.kind) {
+        case PEER_FORWARD:
+            // Accepted even if the ring has since moved the group: the
+            // sender believed we owned it, and bouncing it could loop
+            ownerPublish(origin, originSocket, pkt.groupID, pkt);
+            break;
+
+        case PEER_DELIVER: {
+            int skip = origin == config.nodeID ? static_cast<int>(originSocket) : -1;
+            groups.relay(skip, pkt.groupID, pkt);
+            break;
+        }
+
+        default:
+            LOG_WARN("cluster_unknown_frame", "kind", f.kind, "from", origin);
+    }
+}
+
+// ===== Links =====
+
+Cluster::Link *Cluster::findLink(uint16_t nodeID) {
+    for (auto &link : links) {
+        if (link->addr.nodeID == nodeID) return link.get();
+    }
+    return nullptr;
+}
+
+bool Cluster::sendTo(uint16_t nodeID, const PeerFrame &frame) {
+    Link *link = findLink(nodeID);
+    if (!link) return false;
+
+    std::lock_guard<std::mutex> lock(link->mtx);
+    if (link->fd < 0) return false;
+    if (link->queue.size() >= MAX_LINK_QUEUE) {
+        PerformanceMetrics::getInstance().incrementClusterDropped();
+    } else {
+        link->queue.push_back(frame);
+        link->cv.notify_one();
+    }
+    return true;
+}
+
+void Cluster::writerLoop(Link &link) {
+    std::unique_lock<std::mutex> lock(link.mtx);
+    while (running.load()) {
+        link.cv.wait(lock, [&] {
+            return !running.load() || !link.stale.empty() ||
+                   (link.fd >= 0 && !link.queue.empty());
+        });
+        // Not mid-send here, so dead sockets can be closed safely
+        for (int fd : link.stale) close(fd);
+        link.stale.clear();
+        if (!running.load()) break;
+        if (link.fd < 0 || link.queue.empty()) continue;
+
+        PeerFrame frame = link.queue.front();
+        link.queue.pop_front();
+        int fd = link.fd;
+
+        lock.unlock();
+        bool ok = sendExact(fd, &frame, sizeof(frame));
+        if (!ok) linkDown(link, fd);
+        lock.lock();
+    }
+}
+
+bool Cluster::connectLink(Link &link) {
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    std::string port = std::to_string(link.addr.port);
+    if (getaddrinfo(link.addr.host.c_str(), port.c_str(), &hints, &res) != 0)
+        return false;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    bool ok = fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) == 0;
+    freeaddrinfo(res);
+    if (!ok) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    PeerFrame hello{};
+    hello.kind   = PEER_HELLO;
+    hello.nodeID = htons(config.nodeID);
+    if (!sendExact(fd, &hello, sizeof(hello))) {
+        close(fd);
+        return false;
+    }
+
+    bool changed;
+    {
+        std::lock_guard<std::mutex> lock(link.mtx);
+        link.fd = fd;
+        changed = updateRing(link);
+    }
+    if (changed) ringChanged("peer_up", link.addr.nodeID);
+    return true;
+}
+
+void Cluster::linkDown(Link &link, int fd) {
+    bool changed;
+    {
+        std::lock_guard<std::mutex> lock(link.mtx);
+        if (link.fd != fd) return;  // already handled
+        ::shutdown(fd, SHUT_RDWR);
+        link.stale.push_back(fd);
+        link.fd = -1;
+        link.queue.clear();
+        link.cv.notify_one();
+        changed = updateRing(link);
+    }
+    if (changed) ringChanged("peer_down", link.addr.nodeID);
+}
+
+// Both directions have to be up: each end of a broken TCP connection
+// sees it fail, so the two nodes drop each other together instead of
+// one of them still routing through the other. Called with link.mtx
+// held, which orders membership changes for the peer.
+bool Cluster::updateRing(Link &link) {
+    bool up = link.fd >= 0 && link.inbound > 0;
+    std::lock_guard<std::mutex> lock(ringMtx);
+    if (up == ring.contains(link.addr.nodeID)) return false;
+    if (up) ring.addNode(link.addr.nodeID);
+    else    ring.removeNode(link.addr.nodeID);
+    return true;
+}
+
+void Cluster::ringChanged(const char *reason, uint16_t nodeID) {
+    size_t owned = 0;
+    auto active = groups.getActiveGroups();
+    std::string nodes;
+    {
+        std::lock_guard<std::mutex> lock(ringMtx);
+        for (uint16_t g : active) {
+            if (ring.owner(g) == config.nodeID) ++owned;
+        }
+        for (uint16_t n : ring.nodes()) {
+            if (!nodes.empty()) nodes += ',';
+            nodes += std::to_string(n);
+        }
+    }
+    PerformanceMetrics::getInstance().incrementClusterRebalance();
+    LOG_INFO("cluster_rebalanced", "reason", reason, "peer", nodeID,
+             "nodes", nodes, "local_groups", active.size(), "owned_here", owned);
+}
+
+// Reconnects dropped links and notices peers that went away. Outbound
+// links only ever carry our frames, so readable means EOF or error.
+void Cluster::dialLoop() {
+    std::vector<pollfd> fds;
+    std::vector<Link*> polled;
+
+    while (running.load()) {
+        fds.clear();
+        polled.clear();
+        for (auto &link : links) {
+            int fd;
+            {
+                std::lock_guard<std::mutex> lock(link->mtx);
+                fd = link->fd;
+            }
+            if (fd < 0 && connectLink(*link)) {
+                std::lock_guard<std::mutex> lock(link->mtx);
+                fd = link->fd;
+            }
+            if (fd >= 0) {
+                fds.push_back({fd, POLLIN, 0});
+                polled.push_back(link.get());
+            }
+        }
+
+        if (fds.empty()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(RECONNECT_MS));
+            continue;
+        }
+        if (poll(fds.data(), fds.size(), RECONNECT_MS) <= 0) continue;
+
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i].revents == 0) continue;
+            // The writer may have dropped and closed this fd during the
+            // poll, and the number may already belong to another socket.
+            // Only read it while it is still the link's, under the lock
+            // the writer closes under. Reconnects happen on this thread
+            // only, so the fd still names the same link in linkDown.
+            Link &link = *polled[i];
+            bool down;
+            {
+                std::lock_guard<std::mutex> lock(link.mtx);
+                if (link.fd != fds[i].fd) continue;
+                char byte;
+                down = (fds[i].revents & (POLLERR | POLLHUP)) ||
+                       recv(fds[i].fd, &byte, 1, MSG_DONTWAIT) == 0;
+            }
+            if (down) linkDown(link, fds[i].fd);
+        }
+    }
+}
+
+void Cluster::listenLoop() {
+    while (running.load()) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (!running.load()) break;
+            if (errno == EINTR) continue;
+            LOG_WARN("cluster_accept_failed", "error", std::strerror(errno));
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::lock_guard<std::mutex> lock(inboundMtx);
+        // Reap links that have ended so reconnecting peers don't pile up
+        // finished threads
+        for (auto id : finishedInbound) {
+            auto it = std::find_if(inboundThreads.begin(), inboundThreads.end(),
+                                   [id](const std::thread &t) { return t.get_id() == id; });
+            if (it == inboundThreads.end()) continue;
+            it->join();
+            inboundThreads.erase(it);
+        }
+        finishedInbound.clear();
+        inboundFds.insert(fd);
+        inboundThreads.emplace_back(&Cluster::inboundLoop, this, fd);
+    }
+}
+
+void Cluster::inboundLoop(int fd) {
+    PeerFrame frame;
+    uint16_t peer = 0;
+
+    if (recvExact(fd, &frame, sizeof(frame)) && frame.kind == PEER_HELLO) {
+        peer = ntohs(frame.nodeID);
+        Link *link = findLink(peer);
+        if (!link) {
+            LOG_WARN("cluster_unknown_peer", "peer", peer);
+        } else {
+            LOG_INFO("cluster_peer_connected", "peer", peer);
+            bool changed;
+            {
+                std::lock_guard<std::mutex> lock(link->mtx);
+                ++link->inbound;
+                changed = updateRing(*link);
+            }
+            if (changed) ringChanged("peer_up", peer);
+
+            while (running.load() && recvExact(fd, &frame, sizeof(frame))) {
+                handleFrame(frame);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(link->mtx);
+                --link->inbound;
+                changed = updateRing(*link);
+            }
+            if (changed) ringChanged("peer_down", peer);
+            LOG_INFO("cluster_peer_disconnected", "peer", peer);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(inboundMtx);
+    inboundFds.erase(fd);
+    close(fd);
+    finishedInbound.push_back(std::this_thread::get_id());
+}
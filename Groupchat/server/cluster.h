@@ -0,0 +1,126 @@
+// server/cluster.h
+#pragma once
+
+#include "hash_ring.h"
+#include "group_manager.h"
+#include "shared/protocol.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Several server processes sharing the group space. Each group is owned
+// by one node (consistent hashing over the nodes currently reachable).
+// A MSG_TEXT received anywhere is forwarded to the owner, which logs and
+// indexes it, fans it out to its own members and delivers it to every
+// other node for their local members. Peers are static (--peers); a
+// peer is on the ring while links in both directions are up, so a
+// broken connection takes each end off the other's ring.
+
+struct PeerAddress {
+    uint16_t nodeID;
+    std::string host;
+    uint16_t port;
+};
+
+struct ClusterConfig {
+    uint16_t nodeID = 0;       // 0 = standalone server
+    uint16_t clusterPort = 0;  // peer links are accepted here
+    std::vector<PeerAddress> peers;
+
+    bool enabled() const { return nodeID != 0; }
+
+    // "2@127.0.0.1:9102,3@127.0.0.1:9103"
+    static bool parsePeers(const std::string &spec, std::vector<PeerAddress> &out);
+};
+
+// Peer link messages; never seen by clients
+enum PeerMessage : uint8_t {
+    PEER_HELLO   = 1,  // first frame on a link, nodeID = dialing node
+    PEER_FORWARD = 2,  // to the owner: a client message for its group
+    PEER_DELIVER = 3   // from the owner: fan this out to local members
+};
+
+struct PeerFrame {
+    uint8_t    kind;          // PeerMessage
+    uint8_t    reserved;
+    uint16_t   nodeID;        // HELLO: sender; FORWARD/DELIVER: origin node
+    uint32_t   originSocket;  // sender's socket on the origin node
+    ChatPacket packet;        // network order
+};
+
+class Cluster {
+public:
+    static constexpr int RECONNECT_MS = 500;
+    static constexpr size_t MAX_LINK_QUEUE = 4096;  // frames per peer
+
+    Cluster(const ClusterConfig &config, GroupManager &groups);
+    ~Cluster();
+
+    void start();
+    void stop();
+
+    // Route a client's MSG_TEXT (host order) through the group's owner
+    void publish(int senderSocket, uint16_t groupID, const ChatPacket &pkt);
+
+    uint16_t nodeID() const { return config.nodeID; }
+    uint16_t owner(uint16_t groupID);
+
+private:
+    // Frames are queued and written by a per-link thread, so a slow
+    // peer never stalls the reader threads that feed us
+    struct Link {
+        PeerAddress addr;
+        std::mutex mtx;   // fd and queue
+        std::condition_variable cv;
+        std::deque<PeerFrame> queue;
+        int fd = -1;
+        std::vector<int> stale;  // shut down, closed by the writer
+        int inbound = 0;         // live links accepted from this peer
+        std::thread writer;
+    };
+
+    void listenLoop();
+    void dialLoop();
+    void inboundLoop(int fd);
+    void writerLoop(Link &link);
+
+    Link *findLink(uint16_t nodeID);
+    bool connectLink(Link &link);
+    bool sendTo(uint16_t nodeID, const PeerFrame &frame);
+    void linkDown(Link &link, int fd);
+    bool updateRing(Link &link);  // link.mtx held; true if membership changed
+    void ringChanged(const char *reason, uint16_t nodeID);
+
+    void ownerPublish(uint16_t originNode, uint32_t originSocket,
+                      uint16_t groupID, const ChatPacket &pkt);
+    void handleFrame(const PeerFrame &frame);
+
+    ClusterConfig config;
+    GroupManager &groups;
+
+    std::mutex ringMtx;
+    HashRing ring;
+
+    std::vector<std::unique_ptr<Link>> links;  // one outbound link per peer
+    // Striped by group: keeps each group's owner fan-out order identical
+    // everywhere without serialising unrelated groups
+    static constexpr size_t PUBLISH_STRIPES = 64;
+    std::array<std::mutex, PUBLISH_STRIPES> publishMtx;
+
+    int listenFd = -1;
+    std::atomic<bool> running{false};
+    std::thread listener;
+    std::thread dialer;
+
+    std::mutex inboundMtx;
+    std::unordered_set<int> inboundFds;
+    std::vector<std::thread> inboundThreads;
+    std::vector<std::thread::id> finishedInbound;  // to join on the next accept
+};
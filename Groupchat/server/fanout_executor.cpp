@@ -0,0 +1,86 @@
+// server/fanout_executor.cpp
+#include "fanout_executor.h"
+#include <algorithm>
+
+FanoutExecutor::FanoutExecutor(size_t threads, size_t threshold, ThreadStart onStart)
+    : minMembers(std::max<size_t>(threshold, 1)) {
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([this, i, onStart]() {
+            if (onStart) onStart(i);
+            work();
+        });
+    }
+}
+
+FanoutExecutor::~FanoutExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) worker.join();
+}
+
+size_t FanoutExecutor::partitionsFor(size_t count) const {
+    if (count < minMembers || workers.empty()) return 1;
+    size_t byMembers = (count + MIN_PARTITION - 1) / MIN_PARTITION;
+    return std::max<size_t>(1, std::min(byMembers, workers.size() + 1));
+}
+
+void FanoutExecutor::run(size_t count, const RangeFn &fn) {
+    size_t partitions = partitionsFor(count);
+    if (partitions == 1) {
+        fn(0, count);
+        return;
+    }
+
+    size_t chunk = (count + partitions - 1) / partitions;
+    Batch batch{&fn, (count + chunk - 1) / chunk, {}};
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (size_t begin = chunk; begin < count; begin += chunk) {
+            parts.push_back({&batch, begin, std::min(begin + chunk, count)});
+        }
+    }
+    wake.notify_all();
+
+    // Our own first partition, then any of ours no worker has claimed
+    fn(0, chunk);
+    finish(batch);
+    while (true) {
+        Part part{};
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = std::find_if(parts.begin(), parts.end(),
+                                   [&](const Part &p) { return p.batch == &batch; });
+            if (it == parts.end()) break;
+            part = *it;
+            parts.erase(it);
+        }
+        fn(part.begin, part.end);
+        finish(batch);
+    }
+
+    std::unique_lock<std::mutex> lock(mtx);
+    batch.done.wait(lock, [&]() { return batch.unfinished == 0; });
+}
+
+void FanoutExecutor::finish(Batch &batch) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (--batch.unfinished == 0) batch.done.notify_all();
+}
+
+void FanoutExecutor::work() {
+    while (true) {
+        Part part;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            wake.wait(lock, [this]() { return stopping || !parts.empty(); });
+            if (parts.empty()) return;
+            part = parts.front();
+            parts.pop_front();
+        }
+        (*part.batch->fn)(part.begin, part.end);
+        finish(*part.batch);
+    }
+}
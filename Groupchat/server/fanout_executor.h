@@ -0,0 +1,60 @@
+// server/fanout_executor.h
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Splits one large fan-out into member partitions that run in parallel.
+// The calling thread takes a share of the partitions itself and returns
+// only once every one has finished, so a broadcast still completes
+// before the sender's next message starts. Groups below the threshold
+// are sent inline; small fan-outs don't pay for the hand-off.
+class FanoutExecutor {
+public:
+    using RangeFn = std::function<void(size_t begin, size_t end)>;
+    // Runs first on each helper thread, with its index
+    using ThreadStart = std::function<void(size_t index)>;
+
+    static constexpr size_t DEFAULT_THRESHOLD = 1024;
+    static constexpr size_t MIN_PARTITION     = 256;  // members per partition
+
+    FanoutExecutor(size_t threads, size_t threshold = DEFAULT_THRESHOLD,
+                   ThreadStart onStart = nullptr);
+    ~FanoutExecutor();
+
+    // Calls fn over [0, count), partitioned once count >= threshold
+    void run(size_t count, const RangeFn &fn);
+
+    size_t threshold() const { return minMembers; }
+
+    // Partitions one run(count) would be split into (1 = inline)
+    size_t partitionsFor(size_t count) const;
+
+private:
+    struct Batch {
+        const RangeFn *fn;
+        size_t unfinished;  // guarded by mtx
+        std::condition_variable done;
+    };
+
+    struct Part {
+        Batch *batch;
+        size_t begin;
+        size_t end;
+    };
+
+    void work();
+    void finish(Batch &batch);
+
+    size_t minMembers;
+    std::mutex mtx;
+    std::condition_variable wake;
+    std::deque<Part> parts;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
@@ -1,79 +1,311 @@
 // server/group_manager.cpp
 #include "group_manager.h"
+#include <poll.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
 #include <fstream>
-#include <iostream>
+#include "shared/logger.h"
+#include "shared/metrics.h"
 
-GroupManager::GroupManager()
-    : cache(20) {}
+GroupManager::GroupManager(const std::string &indexDir, size_t fanoutThreshold,
+                           FanoutExecutor::ThreadStart fanoutStart)
+    : cache(20), index(indexDir),
+      fanout(FANOUT_THREADS, fanoutThreshold, std::move(fanoutStart)) {}
+
+namespace {
+
+// Waits at most SEND_TIMEOUT_MS for the socket buffer to drain each
+// time it is full, so a client that stopped reading costs the sending
+// worker a bounded stall instead of holding it indefinitely
+bool sendAll(int sock, const void *data, size_t len) {
+    const char *p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = send(sock, p, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pollfd pfd{sock, POLLOUT, 0};
+            int ready = poll(&pfd, 1, GroupManager::SEND_TIMEOUT_MS);
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready <= 0) return false;
+            continue;
+        }
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// sendfile() has no MSG_DONTWAIT, so the same bound comes from a send
+// timeout: each call returns after SEND_TIMEOUT_MS without progress
+bool sendFileAll(int sock, int fd, uint64_t offset, size_t len) {
+    timeval timeout{GroupManager::SEND_TIMEOUT_MS / 1000,
+                    (GroupManager::SEND_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    off_t at = static_cast<off_t>(offset);
+    while (len > 0) {
+        ssize_t n = sendfile(sock, fd, &at, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        len -= n;
+    }
+    return true;
+}
+
+void recordTraffic(uint16_t groupID, const ChatPacket &pkt) {
+    PerformanceMetrics::getInstance().recordTraffic(
+        groupID, std::string(fixedField(pkt.senderName)),
+        strnlen(pkt.payload, sizeof(pkt.payload)));
+}
+
+// Runs send() under the member's send mutex
+template <typename Send>
+bool sendLocked(GroupMember &member, Send send) {
+    std::lock_guard<std::mutex> lock(member.sendMtx);
+    if (member.closed || member.dropped) return false;
+    if (send()) return true;
+
+    // Timed out or failed, possibly mid-packet: the stream is unusable.
+    // Cut the connection so its reader cleans up, and fail later sends
+    // at once rather than stalling on it again. The fd is still open
+    // (closed is unset), so shutting it down is safe.
+    member.dropped = true;
+    ::shutdown(member.socket, SHUT_RDWR);
+    PerformanceMetrics::getInstance().incrementSlowConsumerDropped();
+    LOG_WARN("member_dropped", "fd", member.socket);
+    return false;
+}
+
+bool sendToMember(GroupMember &member, const void *data, size_t len) {
+    return sendLocked(member, [&] { return sendAll(member.socket, data, len); });
+}
+
+} // namespace
 
 void GroupManager::joinGroup(int clientSocket, uint16_t groupID) {
-    std::lock_guard<std::mutex> lock(mtx);
-    groupMembers[groupID].push_back(clientSocket);
-    clientGroup[clientSocket] = groupID;
+    switchGroup(clientSocket, groupID);
 }
 
 void GroupManager::switchGroup(int clientSocket, uint16_t newGroupID) {
     std::lock_guard<std::mutex> lock(mtx);
     auto it = clientGroup.find(clientSocket);
-    if (it != clientGroup.end()) {
-        uint16_t oldGroup = it->second;
-        auto &vec = groupMembers[oldGroup];
-        vec.erase(std::remove(vec.begin(), vec.end(), clientSocket),
-                  vec.end());
+    if (it == clientGroup.end()) {
+        auto member = std::make_shared<GroupMember>(clientSocket);
+        it = clientGroup.emplace(clientSocket, Membership{newGroupID, {}, member}).first;
+        addMember(newGroupID, it->second.member);
+        return;
     }
-    groupMembers[newGroupID].push_back(clientSocket);
-    clientGroup[clientSocket] = newGroupID;
+
+    Membership &m = it->second;
+    if (m.groupID == newGroupID) return;
+    bool listed = m.receives(newGroupID);
+    if (!m.subscribed.count(m.groupID)) removeMember(m.groupID, clientSocket);
+    m.groupID = newGroupID;
+    if (!listed) addMember(newGroupID, m.member);
 }
 
-void GroupManager::removeClient(int clientSocket) {
+std::vector<uint16_t> GroupManager::subscribe(int clientSocket,
+                                              const std::vector<uint16_t> &groupIDs) {
+    std::vector<uint16_t> added;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = clientGroup.find(clientSocket);
+    if (it == clientGroup.end()) return added;
+
+    Membership &m = it->second;
+    for (uint16_t g : groupIDs) {
+        if (m.subscribed.count(g)) continue;
+        if (m.subscribed.size() >= MAX_SUBSCRIPTIONS) break;
+        bool listed = m.receives(g);
+        m.subscribed.insert(g);
+        if (listed) continue;
+        addMember(g, m.member);
+        added.push_back(g);
+    }
+    return added;
+}
+
+void GroupManager::unsubscribe(int clientSocket, const std::vector<uint16_t> &groupIDs) {
     std::lock_guard<std::mutex> lock(mtx);
     auto it = clientGroup.find(clientSocket);
-    if (it != clientGroup.end()) {
-        uint16_t groupID = it->second;
-        auto &vec = groupMembers[groupID];
-        vec.erase(std::remove(vec.begin(), vec.end(), clientSocket),
-                  vec.end());
+    if (it == clientGroup.end()) return;
+
+    Membership &m = it->second;
+    for (uint16_t g : groupIDs) {
+        // The current group is left with /switch, not here
+        if (!m.subscribed.erase(g) || g == m.groupID) continue;
+        removeMember(g, clientSocket);
+    }
+}
+
+std::vector<uint16_t> GroupManager::groupsOf(int clientSocket) {
+    std::vector<uint16_t> out;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = clientGroup.find(clientSocket);
+    if (it == clientGroup.end()) return out;
+
+    out.push_back(it->second.groupID);
+    for (uint16_t g : it->second.subscribed) {
+        if (g != it->second.groupID) out.push_back(g);
+    }
+    std::sort(out.begin() + 1, out.end());
+    return out;
+}
+
+void GroupManager::removeClient(int clientSocket) {
+    MemberPtr member;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = clientGroup.find(clientSocket);
+        if (it == clientGroup.end()) return;
+        Membership &m = it->second;
+        if (!m.subscribed.count(m.groupID)) removeMember(m.groupID, clientSocket);
+        for (uint16_t g : m.subscribed) removeMember(g, clientSocket);
+        member = std::move(m.member);
         clientGroup.erase(it);
     }
+
+    // A broadcast may still hold an older member list; once this returns
+    // nothing sends to the fd, so closing (and reusing) it is safe
+    std::lock_guard<std::mutex> lock(member->sendMtx);
+    member->closed = true;
 }
 
-void GroupManager::broadcast(int senderSocket,
-                             uint16_t groupID,
-                             const ChatPacket &pktHost) {
-    // Save to cache and log first
-    cache.addMessage(groupID, pktHost);
+void GroupManager::addMember(uint16_t groupID, const MemberPtr &member) {
+    MemberSet &set = groupMembers[groupID];
+    if (!set.slot.emplace(member->socket, set.members.size()).second) return;
+    set.members.push_back(member);
+    set.snapshot.reset();
+}
+
+void GroupManager::removeMember(uint16_t groupID, int clientSocket) {
+    auto it = groupMembers.find(groupID);
+    if (it == groupMembers.end()) return;
+    MemberSet &set = it->second;
+    auto slot = set.slot.find(clientSocket);
+    if (slot == set.slot.end()) return;
+
+    // Move the last member into the hole
+    size_t i = slot->second;
+    set.slot.erase(slot);
+    if (i + 1 != set.members.size()) {
+        set.members[i] = std::move(set.members.back());
+        set.slot[set.members[i]->socket] = i;
+    }
+    set.members.pop_back();
+    set.snapshot.reset();
+    // Subscriptions come and go; don't keep a slot for every group id
+    // ever listed
+    if (set.members.empty()) groupMembers.erase(it);
+}
+
+ChatPacket GroupManager::broadcast(int senderSocket,
+                                 uint16_t groupID,
+                                 const ChatPacket &pktHost) {
+    recordTraffic(groupID, pktHost);
+    // Save to cache and log first; members get the cached sequence number
+    ChatPacket stamped = cache.addMessage(groupID, pktHost);
+    index.add(groupID, stamped);
 
     // Log to file
     {
-        std::ofstream log("../Groupchat/logs/chat_log.txt", std::ios::app);
+        std::ofstream log(CHAT_LOG_PATH, std::ios::app);
         log << pktHost.timestamp << " | group " << groupID
             << " | " << pktHost.senderName << ": " << pktHost.payload << "\n";
     }
 
+    fanOut(senderSocket, groupID, stamped);
+    return stamped;
+}
+
+void GroupManager::relay(int skipSocket, uint16_t groupID,
+                         const ChatPacket &pktHost) {
+    recordTraffic(groupID, pktHost);
+    ChatPacket stamped = cache.addMessage(groupID, pktHost, pktHost.seq != 0);
+    index.add(groupID, stamped);
+    fanOut(skipSocket, groupID, stamped);
+}
+
+void GroupManager::fanOut(int skipSocket, uint16_t groupID,
+                          const ChatPacket &pktHost) {
     ChatPacket netPkt = to_network(pktHost);
 
-    std::lock_guard<std::mutex> lock(mtx);
-    auto it = groupMembers.find(groupID);
-    if (it == groupMembers.end()) return;
+    std::shared_ptr<const MemberList> members;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = groupMembers.find(groupID);
+        if (it == groupMembers.end()) return;
+        MemberSet &set = it->second;
+        if (!set.snapshot) set.snapshot = std::make_shared<const MemberList>(set.members);
+        members = set.snapshot;
+    }
 
-    for (int sock : it->second) {
-        // Optionally skip sender for echo
-        if (sock == senderSocket) continue;
-        ssize_t sent = send(sock, &netPkt, sizeof(netPkt), 0);
-        if (sent <= 0) {
-            std::cerr << "send failed to client " << sock << "\n";
+    // Large groups are split across the fan-out workers; run() returns
+    // once every partition is sent, so per-group order is unchanged
+    auto started = std::chrono::steady_clock::now();
+    const MemberList &list = *members;
+    std::atomic<size_t> sent{0};
+    fanout.run(list.size(), [&](size_t begin, size_t end) {
+        size_t ok = 0;
+        for (size_t i = begin; i < end; ++i) {
+            GroupMember &member = *list[i];
+            // Optionally skip sender for echo
+            if (member.socket == skipSocket) continue;
+            if (sendToMember(member, &netPkt, sizeof(netPkt))) {
+                ++ok;
+            } else {
+                LOG_WARN("send_failed", "fd", member.socket, "group", groupID);
+            }
         }
-    }
+        sent.fetch_add(ok, std::memory_order_relaxed);
+    });
+    PerformanceMetrics::getInstance().recordFanout(
+        groupID, list.size(), fanout.partitionsFor(list.size()),
+        sent.load() * sizeof(netPkt),
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started).count());
+}
+
+GroupManager::MemberPtr GroupManager::memberFor(int clientSocket) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = clientGroup.find(clientSocket);
+    return it != clientGroup.end() ? it->second.member : nullptr;
+}
+
+bool GroupManager::sendTo(int clientSocket, const void *data, size_t len) {
+    MemberPtr member = memberFor(clientSocket);
+    // Not a chat member (yet, or any more): nobody else sends to it
+    if (!member) return sendAll(clientSocket, data, len);
+    return sendToMember(*member, data, len);
+}
+
+bool GroupManager::sendFile(int clientSocket, const void *header, size_t headerLen,
+                            int fd, uint64_t offset, size_t len) {
+    // The body has to follow its header directly, so broadcasts to the
+    // member wait for the chunk; both sends give up (and drop the
+    // member) once the client stops reading for SEND_TIMEOUT_MS
+    auto send = [&] {
+        return sendAll(clientSocket, header, headerLen) &&
+               sendFileAll(clientSocket, fd, offset, len);
+    };
+    MemberPtr member = memberFor(clientSocket);
+    if (!(member ? sendLocked(*member, send) : send())) return false;
+    PerformanceMetrics::getInstance().recordAttachmentOut(len);
+    return true;
 }
 
 std::vector<uint16_t> GroupManager::getActiveGroups() {
     std::lock_guard<std::mutex> lock(mtx);
     std::vector<uint16_t> groups;
     for (const auto &pair : groupMembers) {
-        if (!pair.second.empty()) {
+        if (!pair.second.members.empty()) {
             groups.push_back(pair.first);
         }
     }
@@ -83,3 +315,8 @@ std::vector<uint16_t> GroupManager::getActiveGroups() {
 std::vector<ChatPacket> GroupManager::getGroupHistory(uint16_t groupID) {
     return cache.getHistory(groupID);
 }
+
+GroupCacheManager::Delta GroupManager::getGroupHistorySince(uint16_t groupID, uint32_t since,
+                                                           uint16_t epoch) {
+    return cache.historySince(groupID, since, epoch);
+}
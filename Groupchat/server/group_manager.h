@@ -3,34 +3,126 @@
 
 #include "shared/protocol.h"
 #include "shared/cache.h"
+#include "shared/search_index.h"
+#include "fanout_executor.h"
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
+#include <memory>
 #include <mutex>
+#include <string>
+
+// Append-only log of every broadcast message
+constexpr const char *CHAT_LOG_PATH = "../Groupchat/logs/chat_log.txt";
+// Inverted index segments built from the same messages
+constexpr const char *INDEX_DIR = "../Groupchat/logs/index";
+// Group caches are saved here on shutdown and reloaded on startup
+constexpr const char *CACHE_SNAPSHOT_PATH = "../Groupchat/logs/cache_snapshot.bin";
+
+// One connected chat client. Group member lists share these, so a
+// broadcast can send from a snapshot without holding the manager lock.
+struct GroupMember {
+    explicit GroupMember(int socket) : socket(socket) {}
+
+    const int socket;
+    std::mutex sendMtx;   // one writer at a time, so packets never interleave
+    bool closed = false;  // guarded by sendMtx; set before the fd is closed
+    bool dropped = false; // guarded by sendMtx; a send failed, connection cut
+};
 
 class GroupManager {
 public:
-    GroupManager();
+    static constexpr size_t FANOUT_THREADS = 4;  // helpers for large groups
+    static constexpr size_t MAX_SUBSCRIPTIONS = 64;  // extra groups per connection
+    // Longest a send waits on a full socket buffer before the member
+    // is dropped
+    static constexpr int SEND_TIMEOUT_MS = 1000;
+
+    explicit GroupManager(const std::string &indexDir = INDEX_DIR,
+                          size_t fanoutThreshold = FanoutExecutor::DEFAULT_THRESHOLD,
+                          FanoutExecutor::ThreadStart fanoutStart = nullptr);
 
     void joinGroup(int clientSocket, uint16_t groupID);
+    // Moves the client's current group (where its texts go); groups it
+    // subscribed to stay
     void switchGroup(int clientSocket, uint16_t newGroupID);
+    // Receive these groups too, on the same connection. Returns the ones
+    // the client was not already receiving, in request order.
+    std::vector<uint16_t> subscribe(int clientSocket, const std::vector<uint16_t> &groupIDs);
+    void unsubscribe(int clientSocket, const std::vector<uint16_t> &groupIDs);
+    // Every group the client receives, current one first
+    std::vector<uint16_t> groupsOf(int clientSocket);
     void removeClient(int clientSocket);
 
-    void broadcast(int senderSocket,
-                   uint16_t groupID,
-                   const ChatPacket &pkt);
+    // Returns the message as numbered (seq and epoch) and sent
+    ChatPacket broadcast(int senderSocket,
+                       uint16_t groupID,
+                       const ChatPacket &pkt);
+
+    // Deliver a message another node or process has already logged:
+    // cache and index it, then fan it out to local members. A non-zero
+    // pkt.seq (numbered by the group's cluster owner) is kept with its
+    // epoch, so every node gives the message the same number; zero
+    // numbers it here.
+    void relay(int skipSocket, uint16_t groupID, const ChatPacket &pkt);
+
+    // Send to one client, serialized with broadcasts to the same socket
+    bool sendTo(int clientSocket, const void *data, size_t len);
+    // Header, then `len` bytes of `fd` from `offset` via sendfile(). One
+    // call is one chunk: broadcasts to the client wait for it, not for
+    // the whole file, and never longer than SEND_TIMEOUT_MS per stall.
+    bool sendFile(int clientSocket, const void *header, size_t headerLen,
+                  int fd, uint64_t offset, size_t len);
 
     std::vector<uint16_t> getActiveGroups();
     std::vector<ChatPacket> getGroupHistory(uint16_t groupID);
+    // Only what a client that saw up to `since` (of `epoch`) is missing
+    GroupCacheManager::Delta getGroupHistorySince(uint16_t groupID, uint32_t since,
+                                                  uint16_t epoch);
 
     GroupCacheManager &cacheManager() { return cache; }
+    SearchIndex &searchIndex() { return index; }
 
 private:
+    using MemberPtr  = std::shared_ptr<GroupMember>;
+    using MemberList = std::vector<MemberPtr>;
+
+    // Per client index of the groups it is listed in, so leaving or
+    // disconnecting touches only those groups' member lists
+    struct Membership {
+        uint16_t groupID;                       // current group
+        std::unordered_set<uint16_t> subscribed;  // received as well
+        MemberPtr member;
+
+        bool receives(uint16_t g) const { return g == groupID || subscribed.count(g); }
+    };
+
+    // A group's members, indexed by socket so adding or removing one is
+    // O(1) (swap-remove). Broadcasts send from an immutable snapshot,
+    // rebuilt by the first broadcast after an edit, so churn between
+    // two messages costs one copy rather than one per edit.
+    struct MemberSet {
+        MemberList members;
+        std::unordered_map<int, size_t> slot;        // socket -> index in members
+        std::shared_ptr<const MemberList> snapshot;  // null once edited
+    };
+
+    MemberPtr memberFor(int clientSocket);
+    void fanOut(int skipSocket, uint16_t groupID, const ChatPacket &pktHost);
+    // Callers hold mtx
+    void addMember(uint16_t groupID, const MemberPtr &member);
+    void removeMember(uint16_t groupID, int clientSocket);
+
+    // Guards the maps only; no socket I/O happens under it, so joins and
+    // switches never wait behind a broadcast into slow sockets
     std::mutex mtx;
-    // groupID -> list of client sockets
-    std::unordered_map<uint16_t, std::vector<int>> groupMembers;
-    // client socket -> groupID
-    std::unordered_map<int, uint16_t> clientGroup;
+    // groupID -> its members; groups without members are dropped
+    std::unordered_map<uint16_t, MemberSet> groupMembers;
+    // client socket -> its groups and member
+    std::unordered_map<int, Membership> clientGroup;
 
     GroupCacheManager cache;
+    SearchIndex index;
+    FanoutExecutor fanout;
 };
 
@@ -0,0 +1,60 @@
+// server/hash_ring.cpp
+#include "hash_ring.h"
+#include <algorithm>
+
+namespace {
+
+// FNV-1a over the little-endian bytes of the key, then a final mix so
+// consecutive group ids spread around the ring
+uint64_t hashKey(uint64_t key) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 8; ++i) {
+        h ^= (key >> (i * 8)) & 0xff;
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t nodePoint(uint16_t nodeID, int vnode) {
+    return hashKey((uint64_t(nodeID) << 32) | uint32_t(vnode) | (1ULL << 63));
+}
+
+} // namespace
+
+void HashRing::addNode(uint16_t nodeID) {
+    for (int v = 0; v < VNODES; ++v) {
+        points[nodePoint(nodeID, v)] = nodeID;
+    }
+}
+
+void HashRing::removeNode(uint16_t nodeID) {
+    for (int v = 0; v < VNODES; ++v) {
+        auto it = points.find(nodePoint(nodeID, v));
+        if (it != points.end() && it->second == nodeID) points.erase(it);
+    }
+}
+
+bool HashRing::contains(uint16_t nodeID) const {
+    auto it = points.find(nodePoint(nodeID, 0));
+    return it != points.end() && it->second == nodeID;
+}
+
+uint16_t HashRing::owner(uint16_t groupID) const {
+    if (points.empty()) return 0;
+    auto it = points.lower_bound(hashKey(groupID));
+    if (it == points.end()) it = points.begin();
+    return it->second;
+}
+
+std::vector<uint16_t> HashRing::nodes() const {
+    std::vector<uint16_t> out;
+    for (const auto &p : points) {
+        if (std::find(out.begin(), out.end(), p.second) == out.end())
+            out.push_back(p.second);
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
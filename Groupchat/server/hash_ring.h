@@ -0,0 +1,27 @@
+// server/hash_ring.h
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Consistent-hash ring mapping groups to cluster nodes. Every node is
+// placed at VNODES points so load stays even and adding or removing a
+// node only moves the groups on the arcs it gains or loses.
+class HashRing {
+public:
+    static constexpr int VNODES = 64;
+
+    void addNode(uint16_t nodeID);
+    void removeNode(uint16_t nodeID);
+    bool contains(uint16_t nodeID) const;
+
+    // Node owning groupID; 0 when the ring is empty
+    uint16_t owner(uint16_t groupID) const;
+
+    std::vector<uint16_t> nodes() const;
+    bool empty() const { return points.empty(); }
+
+private:
+    std::map<uint64_t, uint16_t> points;  // ring position -> node
+};
@@ -0,0 +1,187 @@
+// server/history_search.cpp
+#include "history_search.h"
+#include "shared/chat_log.h"
+#include "shared/utils.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+std::string resultKey(uint32_t timestamp, const char *name, size_t nameLen,
+                      const char *payload, size_t payloadLen) {
+    std::string key = std::to_string(timestamp);
+    key += '\0';
+    key.append(name, nameLen);
+    key += '\0';
+    key.append(payload, payloadLen);
+    return key;
+}
+
+} // namespace
+
+HistorySearch::HistorySearch(GroupManager &groups, int clientSocket)
+    : groups(groups), clientSocket(clientSocket), matches(0) {
+    batch.reserve(BATCH_SIZE);
+}
+
+size_t HistorySearch::run(uint16_t groupID, const std::string &query) {
+    TextMatcher matcher(query);
+    matches = 0;
+
+    bool complete = true;
+    if (!matcher.empty()) {
+        // The cache holds the newest messages, which are also in the
+        // log; the log scan skips them and continues with older ones
+        std::vector<ChatPacket> hits;  // newest first
+        std::unordered_set<std::string> cachedKeys;
+        auto cached = groups.getGroupHistory(groupID);
+        for (auto it = cached.rbegin(); it != cached.rend(); ++it) {
+            const ChatPacket &pkt = *it;
+            cachedKeys.insert(resultKey(pkt.timestamp,
+                                        pkt.senderName, strnlen(pkt.senderName, sizeof(pkt.senderName)),
+                                        pkt.payload, strnlen(pkt.payload, sizeof(pkt.payload))));
+            if (hits.size() < MAX_RESULTS && matcher.matches(pkt.payload)) hits.push_back(pkt);
+        }
+
+        if (hits.size() < MAX_RESULTS) complete = scanLog(groupID, matcher, cachedKeys, hits);
+
+        for (auto it = hits.rbegin(); it != hits.rend(); ++it) emit(*it);
+    }
+    std::string summary = "for \"" + query + "\"";
+    if (!complete) summary += " (newest " + std::to_string(MAX_SCAN_BYTES >> 20) + " MB of the log)";
+    finish(groupID, summary);
+    return matches;
+}
+
+size_t HistorySearch::runIndexed(uint16_t groupID, const std::string &query) {
+    std::vector<std::string> words;
+    std::string sender;
+    for (const auto &tok : Utils::split(query, ' ')) {
+        if (tok.rfind("from:", 0) == 0) {
+            sender = tok.substr(5);
+        } else if (!tok.empty()) {
+            words.push_back(tok);
+        }
+    }
+
+    matches = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto hits = groups.searchIndex().query(words, sender, groupID, MAX_RESULTS);
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    // Hits are newest first; send them oldest first like a scan does
+    for (auto it = hits.rbegin(); it != hits.rend(); ++it) {
+        ChatPacket pkt = make_packet(MSG_SEARCH, it->groupID, it->text, 0, it->sender);
+        pkt.timestamp = it->timestamp;
+        emit(pkt);
+    }
+
+    char took[32];
+    std::snprintf(took, sizeof(took), " (index, %.2f ms)", ms);
+    finish(groupID, "for \"" + query + "\"" + took);
+    return matches;
+}
+
+void HistorySearch::finish(uint16_t groupID, const std::string &summary) {
+    flush();
+
+    std::string text = std::to_string(matches) + " match" +
+                       (matches == 1 ? "" : "es") + " " + summary;
+    if (matches >= MAX_RESULTS) text += " (limit reached)";
+    ChatPacket done = to_network(make_packet(MSG_SEARCH_DONE, groupID, text,
+                                             0, "SERVER"));
+    groups.sendTo(clientSocket, &done, sizeof(done));
+}
+
+bool HistorySearch::scanLog(uint16_t groupID, const TextMatcher &matcher,
+                            const std::unordered_set<std::string> &cached,
+                            std::vector<ChatPacket> &hits) {
+    int fd = open(CHAT_LOG_PATH, O_RDONLY);
+    if (fd < 0) return true;
+
+    // Read backwards from the current end in large chunks. The head of
+    // each chunk, up to its first newline, belongs to a line that
+    // continues in the chunk after it, so it is carried over.
+    constexpr size_t CHUNK = 1 << 16;
+    std::vector<char> buf;
+    off_t pos = lseek(fd, 0, SEEK_END);
+    size_t scanned = 0;
+
+    while (pos > 0 && hits.size() < MAX_RESULTS && scanned < MAX_SCAN_BYTES) {
+        size_t n = static_cast<size_t>(std::min<off_t>(pos, CHUNK));
+        pos -= n;
+        buf.insert(buf.begin(), n, '\0');
+        size_t got = 0;
+        while (got < n) {
+            ssize_t r = pread(fd, buf.data() + got, n - got, pos + got);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) break;
+            got += r;
+        }
+        if (got < n) break;
+        scanned += n;
+
+        // Whole lines run from the first newline (or the file start) on
+        size_t first = 0;
+        if (pos > 0) {
+            const char *nl = static_cast<const char*>(std::memchr(buf.data(), '\n', buf.size()));
+            if (!nl) {
+                if (buf.size() > CHUNK * 4) buf.clear();  // overlong line; skip it
+                continue;
+            }
+            first = nl - buf.data() + 1;
+        }
+
+        size_t end = buf.size();
+        while (end > first && hits.size() < MAX_RESULTS) {
+            size_t lineEnd = end;
+            if (buf[lineEnd - 1] == '\n') --lineEnd;
+            const char *nl = lineEnd > first
+                ? static_cast<const char*>(memrchr(buf.data() + first, '\n', lineEnd - first))
+                : nullptr;
+            size_t lineStart = nl ? nl - buf.data() + 1 : first;
+            end = lineStart;
+
+            LogEntry e;
+            if (!parseLogLine(buf.data() + lineStart, lineEnd - lineStart, e)) continue;
+            if (e.groupID != groupID) continue;
+            if (!matcher.matches(e.payload, e.payloadLen)) continue;
+            if (!cached.empty() &&
+                cached.count(resultKey(e.timestamp, e.name, e.nameLen,
+                                       e.payload, e.payloadLen)))
+                continue;
+
+            ChatPacket pkt = make_packet(MSG_SEARCH, groupID,
+                                         std::string(e.payload, e.payloadLen), 0,
+                                         std::string(e.name, e.nameLen));
+            pkt.timestamp = e.timestamp;
+            hits.push_back(pkt);
+        }
+        buf.resize(first);
+    }
+
+    bool complete = pos == 0 || hits.size() >= MAX_RESULTS;
+    close(fd);
+    return complete;
+}
+
+void HistorySearch::emit(const ChatPacket &hostPkt) {
+    ChatPacket pkt = hostPkt;
+    pkt.type = MSG_SEARCH;
+    batch.push_back(to_network(pkt));
+    ++matches;
+    if (batch.size() >= BATCH_SIZE) flush();
+}
+
+void HistorySearch::flush() {
+    if (!batch.empty()) {
+        groups.sendTo(clientSocket, batch.data(), batch.size() * sizeof(ChatPacket));
+    }
+    batch.clear();
+}
@@ -0,0 +1,43 @@
+// server/history_search.h
+#pragma once
+
+#include "group_manager.h"
+#include "shared/text_search.h"
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Answers MSG_SEARCH: looks for payloads matching a query newest first,
+// in the group's cache and then backwards through the persisted chat
+// log, and streams the matches back oldest first in batches of
+// MSG_SEARCH packets, followed by one MSG_SEARCH_DONE.
+class HistorySearch {
+public:
+    static constexpr size_t MAX_RESULTS = 200;
+    static constexpr size_t BATCH_SIZE  = 16;   // packets per send()
+    // Bounds the time a search holds the connection's reader
+    static constexpr size_t MAX_SCAN_BYTES = 16 << 20;
+
+    HistorySearch(GroupManager &groups, int clientSocket);
+
+    // Returns the number of matches sent
+    size_t run(uint16_t groupID, const std::string &query);
+
+    // MSG_FIND: whole words plus an optional "from:<user>" answered from
+    // the inverted index instead of scanning
+    size_t runIndexed(uint16_t groupID, const std::string &query);
+
+private:
+    // Appends to hits, newest first; false if it stopped at MAX_SCAN_BYTES
+    bool scanLog(uint16_t groupID, const TextMatcher &matcher,
+                 const std::unordered_set<std::string> &cached,
+                 std::vector<ChatPacket> &hits);
+    void emit(const ChatPacket &hostPkt);
+    void flush();
+    void finish(uint16_t groupID, const std::string &summary);
+
+    GroupManager &groups;
+    int clientSocket;
+    size_t matches;
+    std::vector<ChatPacket> batch;  // network order
+};
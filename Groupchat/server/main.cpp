@@ -1,38 +1,117 @@
 #include "chat_server.h"
-#include <iostream>
+#include "shared/logger.h"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
 #include <csignal>
 #include <atomic>
+#include <unistd.h>
 
 std::atomic<bool> running(true);
 ChatServer* global_server = nullptr;
 
-void signal_handler(int signal) {
-    std::cout << "\nReceived signal " << signal << ", shutting down gracefully...\n";
-    running.store(false);
+// Only async-signal-safe work here: the drain itself runs on the main
+// thread once run() returns. A second signal exits immediately.
+void signal_handler(int) {
+    if (!running.exchange(false)) {
+        _exit(1);
+    }
+    const char msg[] = "\nShutting down gracefully (signal again to force)...\n";
+    ssize_t ignored = write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+    (void)ignored;
     if (global_server) {
-        global_server->shutdown();
+        global_server->requestStop();
     }
-    exit(0);
 }
 
 int main(int argc, char *argv[]) {
+    // GROUPCHAT_LOG_LEVEL=debug|info|warn|error|off
+    Logger::instance().setLevel(parseLogLevel(std::getenv("GROUPCHAT_LOG_LEVEL")));
+
     // Setup signal handlers
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    // sendfile() has no MSG_NOSIGNAL; a closed peer is seen as EPIPE
+    signal(SIGPIPE, SIG_IGN);
 
+    // server [port] [threads] [--node-id N --cluster-port P --peers ID@HOST:PORT,...]
+    //        [--bus NAME] [--fanout-threshold MEMBERS]
+    //        [--placement none|compact|spread] [--worker-cpus LIST] [--io-cpus LIST]
     int port = 8080;
-    if (argc >= 2) {
-        port = std::stoi(argv[1]);
-    }
-
+    // Every connection (chat or audio) holds a worker while it is open
     size_t numThreads = 4; // could be std::thread::hardware_concurrency()
-    ChatServer server(port, numThreads);
-    global_server = &server;
+    ClusterConfig cluster;
+    std::string busName;
+    size_t fanoutThreshold = FanoutExecutor::DEFAULT_THRESHOLD;
+    AffinityConfig affinity;
+    bool placementGiven = false;
+
+    int positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--node-id" && hasValue) {
+            cluster.nodeID = static_cast<uint16_t>(std::stoul(argv[++i]));
+        } else if (arg == "--cluster-port" && hasValue) {
+            cluster.clusterPort = static_cast<uint16_t>(std::stoul(argv[++i]));
+        } else if (arg == "--peers" && hasValue) {
+            if (!ClusterConfig::parsePeers(argv[++i], cluster.peers)) {
+                std::fprintf(stderr, "bad --peers list: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (arg == "--bus" && hasValue) {
+            busName = argv[++i];
+        } else if (arg == "--fanout-threshold" && hasValue) {
+            fanoutThreshold = std::stoul(argv[++i]);
+        } else if (arg == "--placement" && hasValue) {
+            if (!parsePlacement(argv[++i], affinity.mode)) {
+                std::fprintf(stderr, "bad --placement: %s (none, compact or spread)\n", argv[i]);
+                return 1;
+            }
+            placementGiven = true;
+        } else if ((arg == "--worker-cpus" || arg == "--io-cpus") && hasValue) {
+            std::vector<int> cpus = CpuTopology::parseCpuList(argv[++i]);
+            if (cpus.empty()) {
+                std::fprintf(stderr, "bad %s list: %s\n", arg.c_str(), argv[i]);
+                return 1;
+            }
+            (arg == "--worker-cpus" ? affinity.workerCpus : affinity.ioCpus) = cpus;
+        } else if (positional == 0) {
+            port = std::stoi(arg);
+            ++positional;
+        } else if (positional == 1) {
+            numThreads = std::stoul(arg);
+            ++positional;
+        } else {
+            std::fprintf(stderr, "unexpected argument: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if (cluster.enabled() && !busName.empty()) {
+        std::fprintf(stderr, "--bus and --node-id cannot be combined\n");
+        return 1;
+    }
+    // CPU lists alone imply pinning
+    if (!placementGiven && (!affinity.workerCpus.empty() || !affinity.ioCpus.empty())) {
+        affinity.mode = Placement::SPREAD;
+    }
+    if (cluster.enabled() && cluster.clusterPort == 0) {
+        cluster.clusterPort = static_cast<uint16_t>(port + 1000);
+    }
 
+    std::unique_ptr<ChatServer> server;
     try {
-        server.run();
+        server.reset(new ChatServer(port, numThreads, cluster, busName,
+                                    fanoutThreshold, affinity));
+        global_server = server.get();
+        server->run();
+        server->shutdown();
+        global_server = nullptr;
     } catch (const std::exception &ex) {
-        std::cerr << "Server error: " << ex.what() << std::endl;
+        LOG_ERROR("server_error", "what", ex.what());
+        Logger::instance().flush();
         return 1;
     }
 
@@ -0,0 +1,71 @@
+// server/rate_limiter.cpp
+#include "rate_limiter.h"
+#include <algorithm>
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate(rate), burst(burst), tokens(burst),
+      last(std::chrono::steady_clock::now()) { }
+
+void TokenBucket::refill(std::chrono::steady_clock::time_point now) {
+    std::chrono::duration<double> elapsed = now - last;
+    last = now;
+    tokens = std::min(burst, tokens + elapsed.count() * rate);
+}
+
+bool TokenBucket::tryConsume(double n) {
+    refill(std::chrono::steady_clock::now());
+    if (tokens < n) return false;
+    tokens -= n;
+    return true;
+}
+
+RateLimiter::RateLimiter(double groupRate, double groupBurst)
+    : groupRate(groupRate), groupBurst(groupBurst) { }
+
+bool RateLimiter::allowGroup(uint16_t groupID) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = groupBuckets.find(groupID);
+    if (it == groupBuckets.end()) {
+        it = groupBuckets.emplace(groupID,
+                                  TokenBucket(groupRate, groupBurst)).first;
+    }
+    return it->second.tryConsume();
+}
+
+AdmissionController::AdmissionController(uint32_t targetMicros,
+                                         std::chrono::milliseconds halfLife)
+    : target(targetMicros), halfLife(halfLife),
+      lastSample(std::chrono::steady_clock::now().time_since_epoch().count()) { }
+
+uint64_t AdmissionController::current(std::chrono::steady_clock::time_point now) const {
+    uint64_t lat = ewmaMicros.load(std::memory_order_relaxed);
+    std::chrono::steady_clock::duration idle(
+        now.time_since_epoch().count() - lastSample.load(std::memory_order_relaxed));
+    if (idle <= halfLife) return lat;
+    auto halvings = idle / halfLife;
+    return halvings >= 64 ? 0 : lat >> halvings;
+}
+
+void AdmissionController::observe(uint64_t latencyMicros) {
+    // EWMA with alpha = 1/8 over the decayed estimate, racing updates
+    // just lose a sample
+    auto now = std::chrono::steady_clock::now();
+    uint64_t prev = current(now);
+    uint64_t next = prev - prev / 8 + latencyMicros / 8;
+    ewmaMicros.store(next, std::memory_order_relaxed);
+    lastSample.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+AdmissionController::Decision AdmissionController::admit() const {
+    uint64_t lat = latencyMicros();
+    if (lat > 2ull * target) return SHED;
+    if (lat > target) return DELAY;
+    return ADMIT;
+}
+
+std::chrono::microseconds AdmissionController::delayFor() const {
+    // Back off by the overshoot, capped at the target itself
+    uint64_t lat = latencyMicros();
+    uint64_t over = lat > target ? lat - target : 0;
+    return std::chrono::microseconds(std::min<uint64_t>(over, target));
+}
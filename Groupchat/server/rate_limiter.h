@@ -0,0 +1,69 @@
+// server/rate_limiter.h
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+// Classic token bucket: refills at `rate` tokens/sec up to `burst`.
+// Not thread-safe on its own; per-connection buckets live on the
+// client's worker thread, shared buckets are guarded by RateLimiter.
+class TokenBucket {
+public:
+    TokenBucket(double rate = 20.0, double burst = 40.0);
+
+    bool tryConsume(double tokens = 1.0);
+
+private:
+    void refill(std::chrono::steady_clock::time_point now);
+
+    double rate;
+    double burst;
+    double tokens;
+    std::chrono::steady_clock::time_point last;
+};
+
+// Per-group buckets shared by every sender in the group
+class RateLimiter {
+public:
+    RateLimiter(double groupRate = 200.0, double groupBurst = 400.0);
+
+    bool allowGroup(uint16_t groupID);
+
+private:
+    std::mutex mtx;
+    double groupRate;
+    double groupBurst;
+    std::unordered_map<uint16_t, TokenBucket> groupBuckets;
+};
+
+// Server-wide admission control driven by observed queue latency.
+// Latency is smoothed with an EWMA; above target work is delayed,
+// above twice the target it is shed. Shed work produces no samples, so
+// the estimate halves every halfLife without one and the controller
+// recovers once the backlog is gone.
+class AdmissionController {
+public:
+    enum Decision { ADMIT, DELAY, SHED };
+
+    explicit AdmissionController(uint32_t targetMicros = 20000,
+                                 std::chrono::milliseconds halfLife = std::chrono::milliseconds(500));
+
+    void observe(uint64_t latencyMicros);
+    Decision admit() const;
+
+    // How long a DELAY decision should back off the sender
+    std::chrono::microseconds delayFor() const;
+
+    uint64_t latencyMicros() const { return current(std::chrono::steady_clock::now()); }
+
+private:
+    uint64_t current(std::chrono::steady_clock::time_point now) const;
+
+    uint32_t target;
+    std::chrono::steady_clock::duration halfLife;
+    std::atomic<uint64_t> ewmaMicros{0};
+    std::atomic<std::chrono::steady_clock::rep> lastSample{0};  // time_since_epoch
+};
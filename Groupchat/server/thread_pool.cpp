@@ -1,8 +1,9 @@
 #include "thread_pool.h"
 
-ThreadPool::ThreadPool(size_t threads) : stop(false) {
+ThreadPool::ThreadPool(size_t threads, ThreadStart onStart) : stop(false) {
     for (size_t i = 0; i < threads; ++i) {
-        workers.emplace_back([this]() {
+        workers.emplace_back([this, i, onStart]() {
+            if (onStart) onStart(i);
             while (true) {
                 Task task;
 
@@ -20,7 +20,10 @@ struct Task {
 
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t threads);
+    // Runs first on each new worker, with its index (e.g. to pin it)
+    using ThreadStart = std::function<void(size_t index)>;
+
+    explicit ThreadPool(size_t threads, ThreadStart onStart = nullptr);
     ~ThreadPool();
 
     void enqueue(std::function<void()> task, int priority = 5);
@@ -1,18 +1,118 @@
 #include "cache.h"
 #include "metrics.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+namespace {
+
+// Snapshot file: header, then per group a SnapshotGroup followed by
+// `count` SnapshotEntry records. Packets are stored in host order; a
+// snapshot is only meant to be read back by the same build.
+struct SnapshotHeader {
+    char     magic[8];        // "GCSNAP03"
+    uint32_t groupCount;
+    uint32_t packetSize;      // sizeof(ChatPacket) when written
+    int64_t  createdMicros;
+};
+
+struct SnapshotGroup {
+    uint16_t groupID;
+    uint16_t epoch;           // of lastSeq
+    uint32_t count;
+    uint32_t lastSeq;         // may be past the last saved entry
+    uint32_t reserved2;
+};
+
+struct SnapshotEntry {
+    int64_t    cachedMicros;  // system_clock time the message was cached
+    ChatPacket packet;
+};
+
+constexpr char SNAPSHOT_MAGIC[8] = {'G', 'C', 'S', 'N', 'A', 'P', '0', '3'};
+
+// Non-zero, so a client that never saw a message (seq 0, epoch 0)
+// can't match it
+uint16_t freshEpoch() {
+    std::random_device rd;
+    uint16_t e;
+    do {
+        e = static_cast<uint16_t>(rd());
+    } while (e == 0);
+    return e;
+}
+
+int64_t toMicros(std::chrono::system_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        t.time_since_epoch()).count();
+}
+
+} // namespace
 
 CircularCache::CircularCache(size_t capacity, uint32_t ttlSeconds)
-    : capacity(capacity), ttl(ttlSeconds), head(0), count(0),
-      buffer(capacity) { }
+    : capacity(capacity ? capacity : 1), ttl(ttlSeconds), head(0), count(0) { }
+
+void CircularCache::push(const CachedMessage &msg) {
+    if (buffer.size() < capacity) {
+        // Not wrapped yet: entries end at buffer.size() == head
+        if (buffer.size() == buffer.capacity()) {
+            buffer.reserve(std::min(capacity, std::max<size_t>(4, buffer.size() * 2)));
+        }
+        buffer.push_back(msg);
+    } else {
+        buffer[head] = msg;
+    }
+    head = (head + 1) % capacity;
+    if (count < capacity) count++;
+}
 
 void CircularCache::add(const ChatPacket &pkt) {
     CachedMessage msg;
     msg.packet = pkt;
     msg.timestamp = std::chrono::system_clock::now();
-    
-    buffer[head] = msg;
-    head = (head + 1) % capacity;
-    if (count < capacity) count++;
+    push(msg);
+}
+
+void CircularCache::restore(const CachedMessage &msg) {
+    push(msg);
+}
+
+void CircularCache::resize(size_t newCapacity) {
+    if (newCapacity == 0) newCapacity = 1;
+
+    size_t keep = std::min(count, newCapacity);
+    std::vector<CachedMessage> kept;
+    kept.reserve(newCapacity > count ? newCapacity : keep);
+    size_t start = (head + capacity - count) % capacity;
+    for (size_t i = count - keep; i < count; ++i) {
+        kept.push_back(buffer[(start + i) % capacity]);
+    }
+
+    buffer.swap(kept);
+    capacity = newCapacity;
+    count = keep;
+    head = keep % capacity;
+}
+
+std::vector<CachedMessage> CircularCache::entries() const {
+    std::vector<CachedMessage> out;
+    out.reserve(count);
+
+    auto now = std::chrono::system_clock::now();
+    size_t start = (head + capacity - count) % capacity;
+    for (size_t i = 0; i < count; ++i) {
+        const CachedMessage &m = buffer[(start + i) % capacity];
+        auto age = std::chrono::duration_cast<std::chrono::seconds>(
+            now - m.timestamp).count();
+        if (age < ttl) out.push_back(m);
+    }
+    return out;
 }
 
 void CircularCache::evictExpired() {
@@ -55,18 +155,247 @@ std::vector<ChatPacket> CircularCache::getAll() const {
     return out;
 }
 
-GroupCacheManager::GroupCacheManager(size_t per)
-    : perGroupCapacity(per) { }
+GroupCacheManager::GroupCacheManager(size_t per, size_t budgetBytes)
+    : perGroupCapacity(per ? per : 1), budget(budgetBytes), epoch(freshEpoch()) { }
+
+GroupCacheManager::Numbering &GroupCacheManager::numberingFor(uint16_t groupID) {
+    auto it = numbering.find(groupID);
+    if (it == numbering.end()) it = numbering.emplace(groupID, Numbering{0, epoch}).first;
+    return it->second;
+}
+
+GroupCacheManager::Group &GroupCacheManager::groupFor(uint16_t groupID, size_t capacity) {
+    auto it = caches.find(groupID);
+    if (it != caches.end()) {
+        touch(it->second);
+        return it->second;
+    }
+    lru.push_front(groupID);
+    it = caches.emplace(groupID, Group{CircularCache(capacity), lru.begin()}).first;
+    used += GROUP_OVERHEAD;
+    return it->second;
+}
+
+void GroupCacheManager::touch(Group &g) {
+    lru.splice(lru.begin(), lru, g.lruPos);
+}
+
+// Drop least recently used groups until back under budget; `keep` is
+// the group being written and is never dropped
+void GroupCacheManager::enforceBudget(uint16_t keep) {
+    while (used > budget && !lru.empty() && lru.back() != keep) {
+        auto it = caches.find(lru.back());
+        used -= it->second.cache.bytes() + GROUP_OVERHEAD;
+        caches.erase(it);
+        lru.pop_back();
+        PerformanceMetrics::getInstance().incrementCacheEviction();
+    }
+}
+
+void GroupCacheManager::publishUsage() const {
+    PerformanceMetrics::getInstance().setCacheUsage(used, caches.size());
+}
 
-void GroupCacheManager::addMessage(uint16_t groupID,
-                                   const ChatPacket &pkt) {
+ChatPacket GroupCacheManager::addMessage(uint16_t groupID,
+                                         const ChatPacket &pkt, bool keepNumber) {
     std::lock_guard<std::mutex> lock(mtx);
-    auto &cache = caches[groupID];
-    cache.add(pkt);
+    Numbering &n = numberingFor(groupID);
+    ChatPacket stamped = pkt;
+    if (keepNumber) {
+        // The numbering server restarted without its snapshot: follow
+        // its new epoch from here
+        if (pkt.epoch != n.epoch) n = Numbering{0, pkt.epoch};
+        // Deltas assume the ring is in sequence order; a late message
+        // from an earlier owner is delivered live but not kept for history
+        if (pkt.seq <= n.last) return stamped;
+    } else {
+        stamped.seq   = n.last + 1;
+        stamped.epoch = n.epoch;
+    }
+
+    CircularCache &cache = groupFor(groupID, std::min(MIN_CAPACITY, perGroupCapacity)).cache;
+
+    size_t before = cache.bytes();
+    // Traffic filled the ring: double it, up to the per-group depth
+    if (cache.full() && cache.maxSize() < perGroupCapacity) {
+        cache.resize(std::min(cache.maxSize() * 2, perGroupCapacity));
+    }
+    n.last = stamped.seq;
+    cache.add(stamped);
+    used = used - before + cache.bytes();
+
+    enforceBudget(groupID);
+    publishUsage();
+    return stamped;
 }
 
 std::vector<ChatPacket> GroupCacheManager::getHistory(uint16_t groupID) {
     std::lock_guard<std::mutex> lock(mtx);
-    caches[groupID].evictExpired();
-    return caches[groupID].getAll();
+    auto it = caches.find(groupID);
+    if (it == caches.end()) {
+        PerformanceMetrics::getInstance().incrementCacheMiss();
+        return {};
+    }
+    touch(it->second);
+    it->second.cache.evictExpired();
+    return it->second.cache.getAll();
+}
+
+GroupCacheManager::Delta GroupCacheManager::historySince(uint16_t groupID, uint32_t since,
+                                                         uint16_t sinceEpoch) {
+    Delta delta;
+    if (since == 0) {
+        delta.messages = getHistory(groupID);
+        return delta;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    auto num = numbering.find(groupID);
+    Numbering n = num != numbering.end() ? num->second : Numbering{};
+    bool sameEpoch = num != numbering.end() && sinceEpoch == n.epoch;
+    uint32_t last = n.last;
+    delta.last = last;
+    if (sameEpoch && since == last) return delta;  // up to date
+
+    auto it = caches.find(groupID);
+    if (it != caches.end()) {
+        touch(it->second);
+        it->second.cache.evictExpired();
+        delta.messages = it->second.cache.getAll();
+    } else {
+        PerformanceMetrics::getInstance().incrementCacheMiss();
+    }
+
+    // Continuous only if the oldest message held of the client's epoch
+    // is at most since + 1. Messages of an earlier epoch can precede it.
+    auto first = std::find_if(delta.messages.begin(), delta.messages.end(),
+                              [&](const ChatPacket &p) { return p.epoch == n.epoch; });
+    if (!sameEpoch || since > last || first == delta.messages.end() || first->seq > since + 1) {
+        delta.gap = true;
+        return delta;
+    }
+    delta.messages.erase(delta.messages.begin(),
+                         std::find_if(first, delta.messages.end(),
+                                      [since](const ChatPacket &p) { return p.seq > since; }));
+    return delta;
+}
+
+size_t GroupCacheManager::bytesUsed() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return used;
+}
+
+size_t GroupCacheManager::groupCount() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return caches.size();
+}
+
+bool GroupCacheManager::saveSnapshot(const std::string &path) const {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    SnapshotHeader h{};
+    std::memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+    h.groupCount    = 0;
+    h.packetSize    = sizeof(ChatPacket);
+    h.createdMicros = toMicros(std::chrono::system_clock::now());
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+    // Every group that ever had a message, so its sequence carries on
+    // even if nothing of it is cached any more
+    for (const auto &pair : numbering) {
+        std::vector<CachedMessage> msgs;
+        auto it = caches.find(pair.first);
+        if (it != caches.end()) msgs = it->second.cache.entries();
+
+        SnapshotGroup g{};
+        g.groupID = pair.first;
+        g.epoch   = pair.second.epoch;
+        g.count   = static_cast<uint32_t>(msgs.size());
+        g.lastSeq = pair.second.last;
+        out.write(reinterpret_cast<const char*>(&g), sizeof(g));
+
+        for (const auto &m : msgs) {
+            SnapshotEntry e{};
+            e.cachedMicros = toMicros(m.timestamp);
+            e.packet       = m.packet;
+            out.write(reinterpret_cast<const char*>(&e), sizeof(e));
+        }
+        ++h.groupCount;
+    }
+
+    // Patch the group count now that it is known
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.close();
+    if (!out) return false;
+
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+size_t GroupCacheManager::loadSnapshot(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return 0;
+    }
+
+    void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return 0;
+
+    const char *p   = static_cast<const char*>(base);
+    const char *end = p + st.st_size;
+    size_t restored = 0;
+
+    SnapshotHeader h;
+    std::memcpy(&h, p, sizeof(h));
+    p += sizeof(h);
+
+    if (std::memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) == 0 &&
+        h.packetSize == sizeof(ChatPacket)) {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (uint32_t gi = 0; gi < h.groupCount; ++gi) {
+            if ((size_t)(end - p) < sizeof(SnapshotGroup)) break;
+            SnapshotGroup g;
+            std::memcpy(&g, p, sizeof(g));
+            p += sizeof(g);
+
+            if ((size_t)(end - p) / sizeof(SnapshotEntry) < g.count) break;
+            numbering[g.groupID] = Numbering{g.lastSeq, g.epoch};
+            if (g.count == 0) continue;
+
+            // Sized for what was saved, within the usual bounds
+            size_t capacity = std::max<size_t>(MIN_CAPACITY, g.count);
+            CircularCache &cache = groupFor(g.groupID, std::min(capacity, perGroupCapacity)).cache;
+            size_t before = cache.bytes();
+
+            for (uint32_t i = 0; i < g.count; ++i) {
+                SnapshotEntry e;
+                std::memcpy(&e, p, sizeof(e));
+                p += sizeof(e);
+
+                CachedMessage m;
+                m.packet    = e.packet;
+                m.timestamp = std::chrono::system_clock::time_point(
+                    std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                        std::chrono::microseconds(e.cachedMicros)));
+                cache.restore(m);
+                ++restored;
+            }
+            used = used - before + cache.bytes();
+        }
+        if (!lru.empty()) enforceBudget(lru.front());
+        publishUsage();
+    }
+
+    munmap(base, st.st_size);
+    unlink(path.c_str());
+    return restored;
 }
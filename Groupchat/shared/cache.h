@@ -3,24 +3,42 @@
 
 #include "protocol.h"
 #include <vector>
+#include <list>
 #include <mutex>
 #include <unordered_map>
 #include <chrono>
+#include <string>
 
 struct CachedMessage {
     ChatPacket packet;
     std::chrono::system_clock::time_point timestamp;
 };
 
+// Storage grows with use up to `capacity`, so a group that only ever
+// sees a few messages never allocates a full ring
 class CircularCache {
 public:
     explicit CircularCache(size_t capacity = 20, uint32_t ttlSeconds = 300);
 
     void add(const ChatPacket &pkt);
+    // Re-insert a message keeping its original cache time (snapshots)
+    void restore(const CachedMessage &msg);
     std::vector<ChatPacket> getAll() const;
+    // Unexpired entries, oldest first, with their cache times
+    std::vector<CachedMessage> entries() const;
     void evictExpired();
 
+    // Keeps the newest min(size, newCapacity) messages
+    void resize(size_t newCapacity);
+
+    size_t size() const { return count; }
+    size_t maxSize() const { return capacity; }
+    bool full() const { return count == capacity; }
+    size_t bytes() const { return buffer.capacity() * sizeof(CachedMessage); }
+
 private:
+    void push(const CachedMessage &msg);
+
     size_t capacity;
     uint32_t ttl;  // Time to live in seconds
     size_t head;
@@ -28,16 +46,89 @@ private:
     std::vector<CachedMessage> buffer;
 };
 
+// Per-group history under one global memory budget. A group's ring
+// starts at MIN_CAPACITY and doubles each time traffic fills it, up to
+// capacityPerGroup. When the total goes over budget, the least recently
+// used groups are dropped whole. Reads never create a group, so probing
+// unused group IDs costs nothing.
+//
+// Every cached message gets the next sequence number of its group,
+// starting at 1. Sequences survive eviction and snapshots, so a client
+// can ask for just the messages after the last one it saw.
+//
+// A sequence is only meaningful within its group's epoch. A group first
+// numbered here takes this incarnation's epoch, drawn at random on
+// startup; a snapshot carries each group's epoch across a clean restart.
+// After a crash (no snapshot) numbering starts over under a new epoch,
+// so a client's old sequence is answered with a gap instead of being
+// matched against reused numbers.
 class GroupCacheManager {
 public:
-    GroupCacheManager(size_t capacityPerGroup = 20);
+    static constexpr size_t MIN_CAPACITY   = 4;
+    static constexpr size_t DEFAULT_BUDGET = 4 * 1024 * 1024;  // bytes
 
-    void addMessage(uint16_t groupID, const ChatPacket &pkt);
+    // Messages after a client's last seen sequence
+    struct Delta {
+        std::vector<ChatPacket> messages;  // oldest first
+        // `since` can't be continued from: messages after it were evicted
+        // or expired, it is from another epoch, or it is newer than the
+        // group's last sequence. `messages` is then everything still held.
+        bool gap = false;
+        uint32_t last = 0;  // the group's last sequence (since != 0 only)
+    };
+
+    GroupCacheManager(size_t capacityPerGroup = 20,
+                      size_t budgetBytes = DEFAULT_BUDGET);
+
+    // Returns the cached copy, numbered with the group's next sequence
+    // and epoch. With keepNumber the packet's own seq and epoch, set by
+    // the server that numbered it (the group's cluster owner), are kept.
+    ChatPacket addMessage(uint16_t groupID, const ChatPacket &pkt, bool keepNumber = false);
     std::vector<ChatPacket> getHistory(uint16_t groupID);
+    // since == 0: the whole history, as getHistory
+    Delta historySince(uint16_t groupID, uint32_t since, uint16_t epoch);
+
+    size_t bytesUsed() const;
+    size_t groupCount() const;
+
+    // Binary snapshot of every group's cache for warm restarts.
+    // load returns the number of messages restored, and removes the
+    // file: it describes numbering that stops being current as soon as
+    // this incarnation issues a sequence, so it must not be read again
+    // after a crash.
+    bool saveSnapshot(const std::string &path) const;
+    size_t loadSnapshot(const std::string &path);
 
 private:
+    struct Group {
+        CircularCache cache;
+        std::list<uint16_t>::iterator lruPos;
+    };
+
+    // Callers hold mtx
+    Group &groupFor(uint16_t groupID, size_t capacity);
+    void touch(Group &g);
+    void enforceBudget(uint16_t keep);
+    void publishUsage() const;
+
+    // Map nodes and list links, so empty groups are not free
+    static constexpr size_t GROUP_OVERHEAD = sizeof(Group) + 64;
+
     mutable std::mutex mtx;
     size_t perGroupCapacity;
-    std::unordered_map<uint16_t, CircularCache> caches;
+    size_t budget;
+    size_t used = 0;  // ring storage plus GROUP_OVERHEAD per group
+    std::unordered_map<uint16_t, Group> caches;
+    std::list<uint16_t> lru;  // front = most recently used
+    struct Numbering {
+        uint32_t last = 0;  // last sequence issued
+        uint16_t epoch = 0;
+    };
+    // Callers hold mtx. Created under this incarnation's epoch.
+    Numbering &numberingFor(uint16_t groupID);
+
+    const uint16_t epoch;  // this incarnation's
+    // Per group; kept when a group's cache is dropped
+    std::unordered_map<uint16_t, Numbering> numbering;
 };
 
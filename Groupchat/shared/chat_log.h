@@ -0,0 +1,52 @@
+// shared/chat_log.h
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// One line of chat_log.txt as written by GroupManager::broadcast:
+//   <timestamp> | group <id> | <name>: <payload>
+// Fields point into the caller's buffer; nothing is copied.
+struct LogEntry {
+    uint32_t timestamp;
+    uint16_t groupID;
+    const char *name;
+    size_t nameLen;
+    const char *payload;
+    size_t payloadLen;
+};
+
+// Parse one line (without its '\n'); false for headers/malformed lines
+inline bool parseLogLine(const char *line, size_t len, LogEntry &out) {
+    const char *end = line + len;
+    const char *p = line;
+
+    if (p == end || *p < '0' || *p > '9') return false;
+    uint64_t ts = 0;
+    while (p < end && *p >= '0' && *p <= '9') ts = ts * 10 + (*p++ - '0');
+
+    static const char groupTag[] = " | group ";
+    const size_t tagLen = sizeof(groupTag) - 1;
+    if ((size_t)(end - p) < tagLen || std::memcmp(p, groupTag, tagLen) != 0)
+        return false;
+    p += tagLen;
+
+    if (p == end || *p < '0' || *p > '9') return false;
+    uint32_t group = 0;
+    while (p < end && *p >= '0' && *p <= '9') group = group * 10 + (*p++ - '0');
+
+    if ((size_t)(end - p) < 3 || std::memcmp(p, " | ", 3) != 0) return false;
+    p += 3;
+
+    const char *sep = static_cast<const char*>(memmem(p, end - p, ": ", 2));
+    if (!sep) return false;
+
+    out.timestamp  = static_cast<uint32_t>(ts);
+    out.groupID    = static_cast<uint16_t>(group);
+    out.name       = p;
+    out.nameLen    = sep - p;
+    out.payload    = sep + 2;
+    out.payloadLen = end - out.payload;
+    return true;
+}
@@ -0,0 +1,206 @@
+// shared/cpu_topology.cpp
+#include "cpu_topology.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+std::string readLine(const std::string &path) {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+// CPUs the scheduler lets this process use
+std::vector<int> allowedCpus(const std::string &sysfsRoot) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return CpuTopology::parseCpuList(readLine(sysfsRoot + "/cpu/online"));
+    }
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+} // namespace
+
+std::vector<int> CpuTopology::parseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    std::istringstream ranges(list);
+    for (std::string range; std::getline(ranges, range, ',');) {
+        if (range.empty()) continue;
+        char *end = nullptr;
+        long first = std::strtol(range.c_str(), &end, 10);
+        long last = first;
+        if (*end == '-') last = std::strtol(end + 1, &end, 10);
+        if (*end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE) return {};
+        for (long cpu = first; cpu <= last; ++cpu) cpus.push_back(static_cast<int>(cpu));
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+CpuTopology CpuTopology::detect(const std::string &sysfsRoot) {
+    std::vector<int> allowed = allowedCpus(sysfsRoot);
+    CpuTopology topo;
+
+    // node<N> directories, in node order
+    std::vector<int> nodeIds;
+    if (DIR *dir = opendir((sysfsRoot + "/node").c_str())) {
+        while (dirent *entry = readdir(dir)) {
+            const char *name = entry->d_name;
+            if (std::strncmp(name, "node", 4) != 0 || name[4] < '0' || name[4] > '9') continue;
+            nodeIds.push_back(std::atoi(name + 4));
+        }
+        closedir(dir);
+    }
+    std::sort(nodeIds.begin(), nodeIds.end());
+
+    for (int id : nodeIds) {
+        std::vector<int> cpus;
+        for (int cpu : parseCpuList(readLine(sysfsRoot + "/node/node" +
+                                             std::to_string(id) + "/cpulist"))) {
+            if (std::binary_search(allowed.begin(), allowed.end(), cpu)) cpus.push_back(cpu);
+        }
+        // Memory-only nodes, or none of it allowed to us
+        if (!cpus.empty()) topo.nodes.push_back(std::move(cpus));
+    }
+    if (topo.nodes.empty() && !allowed.empty()) topo.nodes.push_back(allowed);
+    return topo;
+}
+
+int CpuTopology::nodeOf(int cpu) const {
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        if (std::binary_search(nodes[n].begin(), nodes[n].end(), cpu)) return static_cast<int>(n);
+    }
+    return -1;
+}
+
+size_t CpuTopology::cpuCount() const {
+    size_t count = 0;
+    for (const auto &cpus : nodes) count += cpus.size();
+    return count;
+}
+
+bool parsePlacement(const std::string &name, Placement &out) {
+    if (name == "none")    { out = Placement::NONE;    return true; }
+    if (name == "compact") { out = Placement::COMPACT; return true; }
+    if (name == "spread")  { out = Placement::SPREAD;  return true; }
+    return false;
+}
+
+const char *placementName(Placement p) {
+    switch (p) {
+        case Placement::COMPACT: return "compact";
+        case Placement::SPREAD:  return "spread";
+        default:                 return "none";
+    }
+}
+
+ThreadPlacement::ThreadPlacement(const CpuTopology &topology, Placement mode,
+                                 const std::vector<int> &allowed) {
+    if (mode == Placement::NONE) return;
+
+    // Per node, the CPUs this group of threads may use
+    std::vector<std::vector<int>> perNode;
+    for (size_t n = 0; n < topology.nodeCount(); ++n) {
+        std::vector<int> cpus;
+        for (int cpu : topology.cpusOf(n)) {
+            if (allowed.empty() || std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+                cpus.push_back(cpu);
+        }
+        if (!cpus.empty()) perNode.push_back(std::move(cpus));
+    }
+
+    if (mode == Placement::COMPACT) {
+        for (const auto &cpus : perNode) order.insert(order.end(), cpus.begin(), cpus.end());
+        return;
+    }
+    // SPREAD: first CPU of every node, then the second of every node...
+    for (size_t i = 0;; ++i) {
+        bool any = false;
+        for (const auto &cpus : perNode) {
+            if (i < cpus.size()) {
+                order.push_back(cpus[i]);
+                any = true;
+            }
+        }
+        if (!any) break;
+    }
+}
+
+int ThreadPlacement::pinNext() {
+    if (order.empty()) return -1;
+    int cpu = order[next.fetch_add(1) % order.size()];
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? cpu : -1;
+}
+
+pid_t currentThreadId() {
+    return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+ThreadUsage sampleThread(pid_t tid) {
+    ThreadUsage usage;
+    std::string base = "/proc/self/task/" + std::to_string(tid);
+
+    // Fields after the parenthesised name start at field 3 (state);
+    // utime and stime are fields 14 and 15, processor is 39
+    std::string stat = readLine(base + "/stat");
+    size_t paren = stat.rfind(')');
+    if (paren == std::string::npos) return usage;
+    std::istringstream fields(stat.substr(paren + 2));
+    std::vector<std::string> f;
+    for (std::string s; fields >> s;) f.push_back(s);
+    if (f.size() < 37) return usage;
+
+    static const long ticksPerSecond = sysconf(_SC_CLK_TCK);
+    uint64_t ticks = std::strtoull(f[11].c_str(), nullptr, 10) +
+                     std::strtoull(f[12].c_str(), nullptr, 10);
+    usage.cpuMicros = ticks * 1000000 / static_cast<uint64_t>(ticksPerSecond > 0 ? ticksPerSecond : 100);
+    usage.lastCpu = std::atoi(f[36].c_str());
+
+    std::ifstream status(base + "/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.rfind("voluntary_ctxt_switches:", 0) == 0) {
+            usage.voluntary = std::strtoull(line.c_str() + 24, nullptr, 10);
+        } else if (line.rfind("nonvoluntary_ctxt_switches:", 0) == 0) {
+            usage.involuntary = std::strtoull(line.c_str() + 27, nullptr, 10);
+        }
+    }
+    usage.alive = true;
+    return usage;
+}
+
+std::vector<CoreTimes> sampleCores() {
+    std::vector<CoreTimes> cores;
+    std::ifstream stat("/proc/stat");
+    for (std::string line; std::getline(stat, line);) {
+        // "cpuN user nice system idle iowait irq softirq steal ..."
+        if (line.rfind("cpu", 0) != 0 || line.size() < 4 || line[3] < '0' || line[3] > '9') continue;
+        std::istringstream fields(line.substr(3));
+        CoreTimes core{};
+        uint64_t user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+        fields >> core.cpu >> user >> nice >> system >> idle >> iowait >> irq >> softirq >> steal;
+        core.busyTicks = user + nice + system + irq + softirq + steal;
+        core.idleTicks = idle + iowait;
+        cores.push_back(core);
+    }
+    return cores;
+}
@@ -0,0 +1,94 @@
+// shared/cpu_topology.h
+#pragma once
+
+#include <sys/types.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// CPUs grouped by NUMA node, as sysfs reports them
+class CpuTopology {
+public:
+    explicit CpuTopology(std::vector<std::vector<int>> nodes = {}) : nodes(std::move(nodes)) {}
+
+    // /sys/devices/system/node/node*/cpulist, limited to the CPUs this
+    // process may run on. Without NUMA information in sysfs every
+    // allowed CPU is put on node 0.
+    static CpuTopology detect(const std::string &sysfsRoot = "/sys/devices/system");
+
+    // "0-3,8,10-11" -> {0,1,2,3,8,10,11}; empty on a malformed list
+    static std::vector<int> parseCpuList(const std::string &list);
+
+    size_t nodeCount() const { return nodes.size(); }
+    const std::vector<int> &cpusOf(size_t node) const { return nodes[node]; }
+    int nodeOf(int cpu) const;  // -1 if not a known CPU
+    size_t cpuCount() const;
+
+private:
+    std::vector<std::vector<int>> nodes;  // node -> CPUs, ascending
+};
+
+// How a group of threads is laid over the CPUs it may use
+enum class Placement {
+    NONE,     // not pinned, the scheduler decides
+    COMPACT,  // fill one node before moving to the next
+    SPREAD    // round-robin over nodes, so each node gets its share
+};
+
+bool parsePlacement(const std::string &name, Placement &out);
+const char *placementName(Placement p);
+
+// Affinity for the server's threads: request-handling pool workers, and
+// I/O threads (accept loop, bulk lane, fan-out helpers). An empty CPU
+// list means every CPU the process may use.
+struct AffinityConfig {
+    Placement mode = Placement::NONE;
+    std::vector<int> workerCpus;
+    std::vector<int> ioCpus;
+};
+
+// Hands out CPUs to one group of threads in placement order; each
+// thread pins itself as it starts, so its stack and everything it
+// allocates first-touch on its own node.
+class ThreadPlacement {
+public:
+    ThreadPlacement() = default;  // Placement::NONE
+    ThreadPlacement(const CpuTopology &topology, Placement mode,
+                    const std::vector<int> &allowed = {});
+
+    // Pins the calling thread to the next CPU. Returns that CPU, or -1
+    // when not placing (or the kernel refused).
+    int pinNext();
+
+    bool enabled() const { return !order.empty(); }
+    const std::vector<int> &cpus() const { return order; }
+
+private:
+    std::vector<int> order;  // CPUs in the order threads get them
+    std::atomic<size_t> next{0};
+};
+
+// Scheduler counters for one thread of this process, from
+// /proc/self/task/<tid>/stat and status
+struct ThreadUsage {
+    bool alive = false;
+    uint64_t cpuMicros = 0;     // user + system time
+    uint64_t voluntary = 0;     // context switches while blocking
+    uint64_t involuntary = 0;   // preempted
+    int lastCpu = -1;           // where it ran last
+};
+
+pid_t currentThreadId();
+ThreadUsage sampleThread(pid_t tid);
+
+// Cumulative busy and idle time of one CPU, from /proc/stat
+struct CoreTimes {
+    int cpu;
+    uint64_t busyTicks;
+    uint64_t idleTicks;  // idle + iowait
+};
+
+std::vector<CoreTimes> sampleCores();
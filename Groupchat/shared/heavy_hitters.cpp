@@ -0,0 +1,41 @@
+// shared/heavy_hitters.cpp
+#include "heavy_hitters.h"
+
+namespace {
+
+// splitmix64 finalizer: std::hash of an integer is the identity, so
+// row hashes are derived by mixing the key hash with a per-row seed
+uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+} // namespace
+
+CountMinSketch::CountMinSketch(size_t width, size_t depth)
+    : width(width ? width : 1), depth(depth ? depth : 1),
+      counters(this->width * this->depth, 0) { }
+
+size_t CountMinSketch::slot(uint64_t keyHash, size_t row) const {
+    return row * width + mix(keyHash ^ (row * 0x51ed270b27a5a9f1ull)) % width;
+}
+
+void CountMinSketch::add(uint64_t keyHash, uint64_t weight) {
+    for (size_t row = 0; row < depth; ++row) {
+        counters[slot(keyHash, row)] += weight;
+    }
+}
+
+void CountMinSketch::halve(unsigned shift) {
+    for (auto &c : counters) c = shift < 64 ? c >> shift : 0;
+}
+
+uint64_t CountMinSketch::estimate(uint64_t keyHash) const {
+    uint64_t best = UINT64_MAX;
+    for (size_t row = 0; row < depth; ++row) {
+        best = std::min(best, counters[slot(keyHash, row)]);
+    }
+    return best;
+}
@@ -0,0 +1,183 @@
+// shared/heavy_hitters.h
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Count-Min sketch: `depth` rows of `width` counters, one counter per
+// row per key. estimate() never undercounts; it overcounts by at most
+// e * total / width with probability 1 - e^-depth.
+class CountMinSketch {
+public:
+    CountMinSketch(size_t width, size_t depth);
+
+    void add(uint64_t keyHash, uint64_t weight);
+    uint64_t estimate(uint64_t keyHash) const;
+    // Divide every counter by 2^shift
+    void halve(unsigned shift);
+
+private:
+    size_t slot(uint64_t keyHash, size_t row) const;
+
+    size_t width;
+    size_t depth;
+    std::vector<uint64_t> counters;  // depth x width, row-major
+};
+
+// Space-Saving (Metwally et al.) over `capacity` monitored keys, with
+// admission guided by an external estimate. An unmonitored key takes
+// over the smallest counter only once its estimated total (e.g. from a
+// Count-Min sketch) passes that counter, so a long tail of rare keys
+// does not churn the table. Counts never fall below the true value as
+// long as the estimates don't.
+template <typename Key, typename Hash = std::hash<Key>>
+class SpaceSaving {
+public:
+    struct Counter {
+        Key key;
+        uint64_t count;
+        uint64_t error;  // count - error is a guaranteed lower bound
+    };
+
+    explicit SpaceSaving(size_t capacity) : capacity(capacity ? capacity : 1) {
+        counters.reserve(this->capacity);
+        index.reserve(this->capacity);
+    }
+
+    // `estimate` is the key's total including this `weight`
+    void offer(const Key &key, uint64_t weight, uint64_t estimate) {
+        auto it = index.find(key);
+        if (it != index.end()) {
+            counters[it->second].count += weight;
+            return;
+        }
+        if (counters.size() < capacity) {
+            index.emplace(key, counters.size());
+            counters.push_back(Counter{key, estimate, estimate - weight});
+            return;
+        }
+
+        // Only a miss on a full table scans; capacity is small
+        size_t min = 0;
+        for (size_t i = 1; i < counters.size(); ++i) {
+            if (counters[i].count < counters[min].count) min = i;
+        }
+        Counter &c = counters[min];
+        if (estimate <= c.count) return;
+        index.erase(c.key);
+        index.emplace(key, min);
+        c = Counter{key, estimate, estimate - weight};
+    }
+
+    // Divide every count by 2^shift; the lower bounds stay lower bounds
+    // of the equally scaled true counts
+    void halve(unsigned shift) {
+        for (auto &c : counters) {
+            c.count = shift < 64 ? c.count >> shift : 0;
+            c.error = shift < 64 ? c.error >> shift : 0;
+        }
+    }
+
+    // Heaviest first
+    std::vector<Counter> top(size_t n) const {
+        std::vector<Counter> out(counters);
+        std::sort(out.begin(), out.end(), [](const Counter &a, const Counter &b) {
+            return a.count > b.count;
+        });
+        if (out.size() > n) out.resize(n);
+        return out;
+    }
+
+private:
+    size_t capacity;
+    std::vector<Counter> counters;
+    std::unordered_map<Key, size_t, Hash> index;  // key -> counters slot
+};
+
+// Top-K tracker in fixed memory: the Count-Min sketch estimates every
+// key, Space-Saving keeps the heaviest ones by name. Both overestimate,
+// so the smaller of the two counts is reported. Safe to update from
+// several threads.
+//
+// With a half-life every counter is halved once per period, so counts
+// weigh recent traffic and a key that has gone quiet drops out. A
+// steady rate r then settles at r * (halfLife + time since the last
+// halving), which is what rate is computed from.
+template <typename Key, typename Hash = std::hash<Key>>
+class HeavyHitters {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        Key key;
+        uint64_t count;     // estimate, never below the true (decayed) count
+        uint64_t minCount;  // guaranteed lower bound
+        double rate;        // count per second of the window it covers
+    };
+
+    explicit HeavyHitters(size_t capacity = 128, size_t width = 2048, size_t depth = 4,
+                          Clock::duration halfLife = Clock::duration::zero())
+        : sketch(width, depth), monitored(capacity), halfLife(halfLife),
+          started(Clock::now()), lastDecay(started) {}
+
+    void add(const Key &key, uint64_t weight = 1) {
+        uint64_t h = Hash()(key);
+        std::lock_guard<std::mutex> lock(mtx);
+        decayLocked(Clock::now());
+        sketch.add(h, weight);
+        monitored.offer(key, weight, sketch.estimate(h));
+    }
+
+    std::vector<Entry> top(size_t n) const {
+        std::lock_guard<std::mutex> lock(mtx);
+        // Halvings due since the last add() are applied to the output
+        auto now = Clock::now();
+        unsigned shift = static_cast<unsigned>(std::min<Clock::rep>(pendingHalvings(now), 64));
+        auto covered = decayed || shift ? halfLife + (now - lastDecay) % halfLife
+                                        : now - started;
+        double window = std::max(1.0, std::chrono::duration<double>(covered).count());
+
+        std::vector<Entry> out;
+        for (const auto &c : monitored.top(n)) {
+            uint64_t count = std::min(c.count, sketch.estimate(Hash()(c.key)));
+            uint64_t minCount = std::min(count, c.count - c.error);
+            count = shift < 64 ? count >> shift : 0;
+            if (count == 0) continue;
+            minCount = shift < 64 ? minCount >> shift : 0;
+            out.push_back(Entry{c.key, count, minCount, count / window});
+        }
+        std::stable_sort(out.begin(), out.end(), [](const Entry &a, const Entry &b) {
+            return a.count > b.count;
+        });
+        return out;
+    }
+
+private:
+    Clock::rep pendingHalvings(Clock::time_point now) const {
+        return halfLife > Clock::duration::zero() ? (now - lastDecay) / halfLife : 0;
+    }
+
+    void decayLocked(Clock::time_point now) {
+        Clock::rep n = pendingHalvings(now);
+        if (n == 0) return;
+        unsigned shift = static_cast<unsigned>(std::min<Clock::rep>(n, 64));
+        sketch.halve(shift);
+        monitored.halve(shift);
+        lastDecay += n * halfLife;
+        decayed = true;
+    }
+
+    mutable std::mutex mtx;
+    CountMinSketch sketch;
+    SpaceSaving<Key, Hash> monitored;
+    Clock::duration halfLife;  // zero: never decay
+    Clock::time_point started;
+    Clock::time_point lastDecay;
+    bool decayed = false;
+};
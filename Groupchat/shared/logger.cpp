@@ -0,0 +1,202 @@
+// shared/logger.cpp
+#include "logger.h"
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <strings.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr auto SINK_IDLE = std::chrono::milliseconds(10);
+
+const char *levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Info:  return "info";
+        case LogLevel::Warn:  return "warn";
+        case LogLevel::Error: return "error";
+        default:              return "off";
+    }
+}
+
+uint64_t wallMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void writeAll(const std::string &s) {
+    size_t off = 0;
+    while (off < s.size()) {
+        ssize_t n = ::write(STDOUT_FILENO, s.data() + off, s.size() - off);
+        if (n <= 0) return;
+        off += n;
+    }
+}
+
+// Bytes that would let a value break the record across lines or
+// smuggle terminal escapes into the log
+bool isControl(char c) {
+    unsigned char u = static_cast<unsigned char>(c);
+    return u < 0x20 || u == 0x7F;
+}
+
+} // namespace
+
+LogLevel parseLogLevel(const char *name) {
+    if (!name) return LogLevel::Info;
+    if (strcasecmp(name, "debug") == 0) return LogLevel::Debug;
+    if (strcasecmp(name, "warn") == 0)  return LogLevel::Warn;
+    if (strcasecmp(name, "error") == 0) return LogLevel::Error;
+    if (strcasecmp(name, "off") == 0)   return LogLevel::Off;
+    return LogLevel::Info;
+}
+
+Logger &Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() {
+    batch.reserve(RING_RECORDS);
+    sink = std::thread(&Logger::sinkLoop, this);
+}
+
+Logger::~Logger() {
+    stopping.store(true);
+    if (sink.joinable()) sink.join();
+    flush();
+}
+
+// ===== Producer side =====
+
+void Logger::begin(LogRecord &rec, LogLevel level, const char *event) {
+    rec.micros = wallMicros();
+    rec.level  = level;
+    rec.len    = 0;
+    append(rec, event, strlen(event));
+}
+
+void Logger::append(LogRecord &rec, const char *s, size_t n) {
+    size_t room = sizeof(rec.text) - rec.len;
+    if (n > room) n = room;
+    std::memcpy(rec.text + rec.len, s, n);
+    rec.len += n;
+}
+
+void Logger::appendValue(LogRecord &rec, std::string_view s) {
+    bool quote = s.empty() ||
+                 s.find_first_of(" =\"") != std::string_view::npos ||
+                 std::any_of(s.begin(), s.end(), isControl);
+    if (!quote) {
+        append(rec, s.data(), s.size());
+        return;
+    }
+
+    // Quoted; embedded quotes and control characters are flattened so a
+    // record always stays on one line
+    append(rec, "\"", 1);
+    for (char c : s) {
+        if (c == '"') c = '\'';
+        else if (isControl(c)) c = ' ';
+        append(rec, &c, 1);
+    }
+    append(rec, "\"", 1);
+}
+
+void Logger::appendValue(LogRecord &rec, double v) {
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%.3f", v);
+    if (n > 0) append(rec, buf, std::min<size_t>(n, sizeof(buf) - 1));
+}
+
+Logger::ThreadBuffer *Logger::localBuffer() {
+    // Marks the buffer retired when the thread exits; the sink frees it
+    // once it has been drained
+    struct Holder {
+        ThreadBuffer *buf = nullptr;
+        ~Holder() {
+            if (buf) buf->retired.store(true, std::memory_order_release);
+        }
+    };
+    thread_local Holder holder;
+
+    if (!holder.buf) {
+        auto buf = std::make_unique<ThreadBuffer>();
+        holder.buf = buf.get();
+        std::lock_guard<std::mutex> lock(buffersMtx);
+        buffers.push_back(std::move(buf));
+    }
+    return holder.buf;
+}
+
+void Logger::submit(const LogRecord &rec) {
+    if (!localBuffer()->ring.tryPush(rec)) {
+        droppedRecords.fetch_add(1, std::memory_order_relaxed);
+        PerformanceMetrics::getInstance().incrementLogDropped();
+    }
+}
+
+// ===== Sink side =====
+
+void Logger::drainLocked() {
+    batch.clear();
+    {
+        std::lock_guard<std::mutex> lock(buffersMtx);
+        for (auto it = buffers.begin(); it != buffers.end(); ) {
+            ThreadBuffer &b = **it;
+            bool retired = b.retired.load(std::memory_order_acquire);
+            LogRecord rec;
+            while (b.ring.tryPop(rec)) batch.push_back(rec);
+            if (retired) {
+                it = buffers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    if (batch.empty()) return;
+
+    // Interleave threads by time; each ring is already in order
+    std::stable_sort(batch.begin(), batch.end(),
+                     [](const LogRecord &a, const LogRecord &b) {
+                         return a.micros < b.micros;
+                     });
+
+    out.clear();
+    char ts[40];
+    for (const LogRecord &rec : batch) {
+        time_t secs = rec.micros / 1000000;
+        struct tm tm;
+        gmtime_r(&secs, &tm);
+        size_t n = strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", &tm);
+        snprintf(ts + n, sizeof(ts) - n, ".%06uZ",
+                 static_cast<unsigned>(rec.micros % 1000000));
+
+        out += "ts=";
+        out += ts;
+        out += " level=";
+        out += levelName(rec.level);
+        out += " event=";
+        out.append(rec.text, rec.len);
+        out += '\n';
+    }
+    writeAll(out);
+}
+
+void Logger::sinkLoop() {
+    while (!stopping.load()) {
+        {
+            std::lock_guard<std::mutex> lock(drainMtx);
+            drainLocked();
+        }
+        std::this_thread::sleep_for(SINK_IDLE);
+    }
+}
+
+void Logger::flush() {
+    std::lock_guard<std::mutex> lock(drainMtx);
+    drainLocked();
+}
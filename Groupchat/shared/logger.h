@@ -0,0 +1,141 @@
+// shared/logger.h
+#pragma once
+
+#include "spsc_ring.h"
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Leveled, structured (logfmt) logger. Call sites format one fixed-size
+// record on their own thread and push it into that thread's SPSC ring;
+// a single background sink drains every ring to stdout. A full ring
+// drops the record and bumps a counter instead of blocking the caller.
+//
+//   LOG_INFO("client_connected", "fd", sock);
+//   -> ts=2026-10-19T12:00:00.123456Z level=info event=client_connected fd=5
+//
+// Per-packet logging goes through LOG_PACKET, which compiles to nothing
+// unless GROUPCHAT_PACKET_LOG is defined (cmake -DGROUPCHAT_PACKET_LOG=ON).
+
+enum class LogLevel : uint8_t { Debug, Info, Warn, Error, Off };
+
+// Parses "debug", "info", "warn", "error" or "off"; Info otherwise
+LogLevel parseLogLevel(const char *name);
+
+struct LogRecord {
+    uint64_t micros;          // wall clock
+    LogLevel level;
+    uint16_t len;
+    char text[244];           // "event key=value ...", truncated to fit
+};
+
+// NUL-padded fixed-width field (ChatPacket::senderName, payload, ...)
+template <size_t N>
+std::string_view fixedField(const char (&field)[N]) {
+    return std::string_view(field, strnlen(field, N));
+}
+
+class Logger {
+public:
+    static constexpr size_t RING_RECORDS = 512;  // per thread
+
+    static Logger &instance();
+
+    void setLevel(LogLevel level) { minLevel.store(level, std::memory_order_relaxed); }
+    bool enabled(LogLevel level) const {
+        return level >= minLevel.load(std::memory_order_relaxed);
+    }
+
+    // write(level, event, key1, value1, key2, value2, ...)
+    template <typename... Fields>
+    void write(LogLevel level, const char *event, const Fields &... fields) {
+        static_assert(sizeof...(Fields) % 2 == 0, "log fields come in key/value pairs");
+        LogRecord rec;
+        begin(rec, level, event);
+        appendFields(rec, fields...);
+        submit(rec);
+    }
+
+    // Blocks until everything queued so far has been written
+    void flush();
+
+    size_t dropped() const { return droppedRecords.load(); }
+
+    ~Logger();
+
+private:
+    struct ThreadBuffer {
+        SpscRing<LogRecord, RING_RECORDS> ring;
+        std::atomic<bool> retired{false};  // owning thread has exited
+    };
+
+    Logger();
+
+    static void begin(LogRecord &rec, LogLevel level, const char *event);
+    void submit(const LogRecord &rec);
+    ThreadBuffer *localBuffer();
+
+    static void append(LogRecord &rec, const char *s, size_t n);
+    static void appendValue(LogRecord &rec, std::string_view s);
+    static void appendValue(LogRecord &rec, double v);
+
+    template <typename T,
+              typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    static void appendValue(LogRecord &rec, T v) {
+        char buf[24];
+        auto res = std::to_chars(buf, buf + sizeof(buf), v);
+        append(rec, buf, res.ptr - buf);
+    }
+
+    static void appendFields(LogRecord &) { }
+
+    template <typename K, typename V, typename... Rest>
+    static void appendFields(LogRecord &rec, const K &key, const V &value,
+                             const Rest &... rest) {
+        append(rec, " ", 1);
+        append(rec, key, strlen(key));
+        append(rec, "=", 1);
+        appendValue(rec, value);
+        appendFields(rec, rest...);
+    }
+
+    void sinkLoop();
+    void drainLocked();
+
+    std::atomic<LogLevel> minLevel{LogLevel::Info};
+    std::atomic<size_t> droppedRecords{0};
+
+    std::mutex buffersMtx;  // the list itself, not the rings
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    std::mutex drainMtx;    // one consumer at a time per ring
+    std::vector<LogRecord> batch;
+    std::string out;
+
+    std::atomic<bool> stopping{false};
+    std::thread sink;
+};
+
+#define GROUPCHAT_LOG(level, ...)                                   \
+    do {                                                            \
+        if (Logger::instance().enabled(level))                      \
+            Logger::instance().write(level, __VA_ARGS__);           \
+    } while (0)
+
+#define LOG_DEBUG(...) GROUPCHAT_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...)  GROUPCHAT_LOG(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...)  GROUPCHAT_LOG(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) GROUPCHAT_LOG(LogLevel::Error, __VA_ARGS__)
+
+#ifdef GROUPCHAT_PACKET_LOG
+#define LOG_PACKET(...) LOG_DEBUG(__VA_ARGS__)
+#else
+#define LOG_PACKET(...) do { } while (0)
+#endif
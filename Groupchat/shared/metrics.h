@@ -1,11 +1,17 @@
 // shared/metrics.h
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <atomic>
 #include <mutex>
 #include <fstream>
-#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "logger.h"
+#include "heavy_hitters.h"
+#include "cpu_topology.h"
 
 class PerformanceMetrics {
 public:
@@ -26,6 +32,17 @@ public:
         cacheMisses.fetch_add(1);
     }
 
+    // Group caches: bytes held against the budget and live groups
+    void setCacheUsage(size_t bytes, size_t groups) {
+        cacheBytes.store(bytes, std::memory_order_relaxed);
+        cacheGroups.store(groups, std::memory_order_relaxed);
+        raiseMax(cacheBytesPeak, bytes);
+    }
+
+    void incrementCacheEviction() {
+        cacheEvictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
     void recordThreadUsage(size_t active) {
         std::lock_guard<std::mutex> lock(mtx);
         activeThreads = active;
@@ -35,6 +52,167 @@ public:
         pageFaults.fetch_add(1);
     }
 
+    void incrementClientThrottled() {
+        clientThrottled.fetch_add(1);
+    }
+
+    void incrementGroupThrottled() {
+        groupThrottled.fetch_add(1);
+    }
+
+    void incrementAdmissionDelayed() {
+        admissionDelayed.fetch_add(1);
+    }
+
+    void incrementAdmissionShed() {
+        admissionShed.fetch_add(1);
+    }
+
+    void incrementBulkShed() {
+        bulkShed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void incrementSlowConsumerDropped() {
+        slowConsumersDropped.fetch_add(1);
+    }
+
+    void incrementAudioRelayed() {
+        audioRelayed.fetch_add(1);
+    }
+
+    void incrementAudioLate() {
+        audioLate.fetch_add(1);
+    }
+
+    void incrementAudioOverflow() {
+        audioOverflow.fetch_add(1);
+    }
+
+    void incrementLogDropped() {
+        logDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void incrementClusterForwarded() {
+        clusterForwarded.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void incrementClusterDelivered() {
+        clusterDelivered.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void incrementClusterDropped() {
+        clusterDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void incrementClusterRebalance() {
+        clusterRebalances.fetch_add(1);
+    }
+
+    void incrementBusPublished() {
+        busPublished.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void incrementBusReceived() {
+        busReceived.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void addBusLost(uint64_t n) {
+        busLost.fetch_add(n);
+    }
+
+    void incrementUnknownPacket() {
+        unknownPackets.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Control-plane requests (join/switch/list): arrival to reply sent
+    void recordControlLatency(uint64_t micros) {
+        controlRequests.fetch_add(1, std::memory_order_relaxed);
+        controlMicros.fetch_add(micros, std::memory_order_relaxed);
+        if (micros >= 1000) controlOverMs.fetch_add(1, std::memory_order_relaxed);
+        raiseMax(controlMaxMicros, micros);
+    }
+
+    // Text messages: time spent queued on the bulk lane before fan-out
+    void recordBulkQueueWait(uint64_t micros) {
+        bulkQueued.fetch_add(1, std::memory_order_relaxed);
+        bulkWaitMicros.fetch_add(micros, std::memory_order_relaxed);
+        raiseMax(bulkMaxWaitMicros, micros);
+    }
+
+    // One client recv() syscall and the whole packets it completed
+    void recordRecv(size_t packets) {
+        recvCalls.fetch_add(1, std::memory_order_relaxed);
+        packetsReceived.fetch_add(packets, std::memory_order_relaxed);
+    }
+
+    // Attachment bytes received (spliced = moved socket -> file in the
+    // kernel) and sent with sendfile()
+    void recordAttachmentIn(uint64_t bytes, uint64_t spliced) {
+        attachBytesIn.fetch_add(bytes, std::memory_order_relaxed);
+        attachSpliced.fetch_add(spliced, std::memory_order_relaxed);
+    }
+
+    void recordAttachmentOut(uint64_t bytes) {
+        attachBytesOut.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void incrementAttachmentStored() {
+        attachStored.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // A long-running thread, registered by itself as it starts (pinned
+    // CPU or -1). Its CPU time and context switches are read from /proc
+    // when metrics are logged, or as it exits if that comes first.
+    void registerThread(const std::string &name, int pinnedCpu) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            threads.push_back(ThreadInfo{name, currentThreadId(), pinnedCpu,
+                                         std::chrono::steady_clock::now()});
+        }
+        thread_local ThreadExit onExit;
+        (void)onExit;
+    }
+
+    // History sent for a JOIN/SWITCH; delta = the client gave its last
+    // seen sequence, gap = the server could not continue from it
+    void recordHistorySync(size_t packets, bool delta, bool gap) {
+        historyPackets.fetch_add(packets, std::memory_order_relaxed);
+        if (delta) historyDeltas.fetch_add(1, std::memory_order_relaxed);
+        if (gap) historyGaps.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // One message entering fan-out on this server, for the heavy-hitter
+    // sketches: groups by messages, senders by payload bytes
+    void recordTraffic(uint16_t groupID, const std::string &sender, size_t payloadBytes) {
+        hotGroups.add(groupID);
+        noisySenders.add(sender, payloadBytes);
+    }
+
+    static constexpr std::chrono::seconds TRAFFIC_HALF_LIFE{60};
+    using GroupHitters  = HeavyHitters<uint16_t>;
+    using SenderHitters = HeavyHitters<std::string>;
+
+    // Queryable while running; estimates never undercount. Counts
+    // halve every TRAFFIC_HALF_LIFE, so they and their rates reflect
+    // the last few minutes rather than the whole uptime.
+    std::vector<GroupHitters::Entry> topGroups(size_t n) const { return hotGroups.top(n); }
+    std::vector<SenderHitters::Entry> topSenders(size_t n) const { return noisySenders.top(n); }
+    std::vector<GroupHitters::Entry> topFanout(size_t n) const { return fanoutBytes.top(n); }
+
+    // One broadcast's fan-out: members it covered, partitions it was
+    // split into (1 = sent inline), bytes written and how long it took
+    void recordFanout(uint16_t groupID, size_t members, size_t partitions,
+                      uint64_t bytes, uint64_t micros) {
+        if (bytes) fanoutBytes.add(groupID, bytes);
+        std::lock_guard<std::mutex> lock(fanoutMtx);
+        FanoutStats &s = fanoutStats[groupID];
+        ++s.broadcasts;
+        if (partitions > 1) ++s.partitioned;
+        s.members = members;
+        s.totalMicros += micros;
+        if (micros > s.maxMicros) s.maxMicros = micros;
+    }
+
     void logMetrics() {
         std::lock_guard<std::mutex> lock(mtx);
         
@@ -49,6 +227,14 @@ public:
             cacheHitRate = (double)cacheHits.load() / totalCache * 100.0;
         }
 
+        size_t control = controlRequests.load();
+        double controlAvg = control ? (double)controlMicros.load() / control : 0;
+        size_t queued = bulkQueued.load();
+        double bulkAvg = queued ? (double)bulkWaitMicros.load() / queued : 0;
+
+        size_t recvs = recvCalls.load();
+        double perRecv = recvs ? (double)packetsReceived.load() / recvs : 0;
+
         std::ofstream log("../Groupchat/logs/performance.txt", std::ios::app);
         log << "=== Performance Metrics ===\n";
         log << "Uptime: " << duration << " seconds\n";
@@ -57,23 +243,213 @@ public:
         log << "Cache Hits: " << cacheHits.load() << "\n";
         log << "Cache Misses: " << cacheMisses.load() << "\n";
         log << "Cache Hit Rate: " << cacheHitRate << "%\n";
+        log << "Cache Memory: " << cacheBytes.load() << " bytes ("
+            << cacheGroups.load() << " groups, peak " << cacheBytesPeak.load() << ")\n";
+        log << "Cache Evictions: " << cacheEvictions.load() << "\n";
         log << "Active Threads: " << activeThreads << "\n";
         log << "Page Faults: " << pageFaults.load() << "\n";
+        log << "Throttled (client): " << clientThrottled.load() << "\n";
+        log << "Throttled (group): " << groupThrottled.load() << "\n";
+        log << "Admission Delayed: " << admissionDelayed.load() << "\n";
+        log << "Admission Shed: " << admissionShed.load() << "\n";
+        log << "Bulk Lane Shed: " << bulkShed.load() << "\n";
+        log << "Slow Consumers Dropped: " << slowConsumersDropped.load() << "\n";
+        log << "Audio Frames Relayed: " << audioRelayed.load() << "\n";
+        log << "Audio Frames Late: " << audioLate.load() << "\n";
+        log << "Audio Jitter Overflow: " << audioOverflow.load() << "\n";
+        log << "Log Records Dropped: " << logDropped.load() << "\n";
+        log << "Cluster Forwarded: " << clusterForwarded.load() << "\n";
+        log << "Cluster Delivered: " << clusterDelivered.load() << "\n";
+        log << "Cluster Dropped: " << clusterDropped.load() << "\n";
+        log << "Cluster Rebalances: " << clusterRebalances.load() << "\n";
+        log << "Unknown Packets: " << unknownPackets.load() << "\n";
+        log << "Bus Published: " << busPublished.load() << "\n";
+        log << "Bus Received: " << busReceived.load() << "\n";
+        log << "Bus Lost: " << busLost.load() << "\n";
+        log << "Control Requests: " << control << "\n";
+        log << "Control Latency Avg: " << controlAvg << " us\n";
+        log << "Control Latency Max: " << controlMaxMicros.load() << " us\n";
+        log << "Control Over 1ms: " << controlOverMs.load() << "\n";
+        log << "Bulk Queue Wait Avg: " << bulkAvg << " us\n";
+        log << "Bulk Queue Wait Max: " << bulkMaxWaitMicros.load() << " us\n";
+        log << "Recv Syscalls: " << recvs << "\n";
+        log << "Packets Received: " << packetsReceived.load() << "\n";
+        log << "Packets per Recv: " << perRecv << "\n";
+        log << "Attachments Stored: " << attachStored.load() << "\n";
+        log << "Attachment Bytes In: " << attachBytesIn.load()
+            << " (" << attachSpliced.load() << " spliced)\n";
+        log << "Attachment Bytes Out: " << attachBytesOut.load() << "\n";
+        log << "History Packets Sent: " << historyPackets.load() << "\n";
+        log << "History Delta Syncs: " << historyDeltas.load()
+            << " (" << historyGaps.load() << " gaps)\n";
+        {
+            std::lock_guard<std::mutex> fanoutLock(fanoutMtx);
+            for (const auto &entry : fanoutStats) {
+                const FanoutStats &s = entry.second;
+                log << "Fan-out group " << entry.first << ": "
+                    << s.broadcasts << " broadcasts (" << s.partitioned
+                    << " partitioned), " << s.members << " members, avg "
+                    << (double)s.totalMicros / s.broadcasts << " us, max "
+                    << s.maxMicros << " us\n";
+            }
+        }
+        for (const auto &e : hotGroups.top(TOP_LOGGED)) {
+            log << "Hot group " << e.key << ": ~" << e.count << " recent messages (>= "
+                << e.minCount << "), " << e.rate << " msg/sec\n";
+        }
+        for (const auto &e : noisySenders.top(TOP_LOGGED)) {
+            log << "Noisy sender " << e.key << ": ~" << e.count << " recent payload bytes (>= "
+                << e.minCount << "), " << e.rate << " bytes/sec\n";
+        }
+        for (const auto &e : fanoutBytes.top(TOP_LOGGED)) {
+            log << "Fan-out bytes group " << e.key << ": ~" << e.count << " recent (>= "
+                << e.minCount << "), " << e.rate << " bytes/sec\n";
+        }
+        logThreads(log);
         log << "===========================\n\n";
         log.close();
 
-        std::cout << "Performance metrics logged\n";
+        LOG_INFO("metrics_logged", "messages", messageCount.load(),
+                 "msg_rate", msgRate, "cache_hit_pct", cacheHitRate,
+                 "control_avg_us", controlAvg,
+                 "control_max_us", controlMaxMicros.load());
     }
 
 private:
+    static constexpr size_t TOP_LOGGED = 10;
+
+    struct FanoutStats {
+        size_t broadcasts = 0;
+        size_t partitioned = 0;
+        size_t members = 0;       // at the latest broadcast
+        uint64_t totalMicros = 0;
+        uint64_t maxMicros = 0;
+    };
+
+    struct ThreadInfo {
+        std::string name;
+        pid_t tid;
+        int pinnedCpu;
+        std::chrono::steady_clock::time_point started;
+        bool exited = false;
+        std::chrono::steady_clock::time_point ended{};
+        ThreadUsage last{};  // as it exited
+    };
+
+    // Destroyed as a registered thread exits
+    struct ThreadExit {
+        ~ThreadExit() { getInstance().retireThread(currentThreadId()); }
+    };
+
+    void retireThread(pid_t tid) {
+        ThreadUsage usage = sampleThread(tid);
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto &t : threads) {
+            if (t.tid != tid || t.exited) continue;
+            t.exited = true;
+            t.ended = std::chrono::steady_clock::now();
+            t.last = usage;
+        }
+    }
+
+    // Per thread: busy = on-CPU time, idle = the rest of its lifetime.
+    // Per core: utilisation by every process since startup. Caller
+    // holds mtx.
+    void logThreads(std::ofstream &log) {
+        CpuTopology topology = CpuTopology::detect();
+        auto now = std::chrono::steady_clock::now();
+        for (const auto &t : threads) {
+            ThreadUsage u = t.exited ? t.last : sampleThread(t.tid);
+            if (!u.alive) continue;
+            double lifetime = std::chrono::duration<double>(
+                (t.exited ? t.ended : now) - t.started).count();
+            double busy = u.cpuMicros / 1e6;
+            double idle = lifetime > busy ? lifetime - busy : 0;
+            log << "Thread " << t.name << ": ";
+            if (t.pinnedCpu >= 0) {
+                log << "cpu " << t.pinnedCpu << " (node " << topology.nodeOf(t.pinnedCpu) << ")";
+            } else {
+                log << "unpinned";
+            }
+            log << ", last ran on " << u.lastCpu << ", busy " << busy << " s, idle "
+                << idle << " s (" << (lifetime > 0 ? busy / lifetime * 100.0 : 0)
+                << "% busy), context switches " << u.voluntary << " voluntary / "
+                << u.involuntary << " involuntary\n";
+        }
+
+        for (const auto &core : sampleCores()) {
+            uint64_t busy = core.busyTicks, idle = core.idleTicks;
+            for (const auto &start : startCores) {
+                if (start.cpu != core.cpu) continue;
+                busy -= std::min(busy, start.busyTicks);
+                idle -= std::min(idle, start.idleTicks);
+            }
+            uint64_t total = busy + idle;
+            log << "Core " << core.cpu << " (node " << topology.nodeOf(core.cpu) << "): "
+                << (total ? (double)busy / total * 100.0 : 0) << "% busy\n";
+        }
+    }
+
+    static void raiseMax(std::atomic<uint64_t> &max, uint64_t v) {
+        uint64_t cur = max.load(std::memory_order_relaxed);
+        while (v > cur && !max.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+        }
+    }
+
     PerformanceMetrics() : startTime(std::chrono::system_clock::now()),
-                           activeThreads(0) {}
+                           activeThreads(0), startCores(sampleCores()) {}
 
     std::chrono::system_clock::time_point startTime;
     std::atomic<size_t> messageCount{0};
     std::atomic<size_t> cacheHits{0};
     std::atomic<size_t> cacheMisses{0};
+    std::atomic<uint64_t> cacheBytes{0};
+    std::atomic<uint64_t> cacheBytesPeak{0};
+    std::atomic<size_t> cacheGroups{0};
+    std::atomic<size_t> cacheEvictions{0};
     std::atomic<size_t> pageFaults{0};
+    std::atomic<size_t> clientThrottled{0};
+    std::atomic<size_t> groupThrottled{0};
+    std::atomic<size_t> admissionDelayed{0};
+    std::atomic<size_t> admissionShed{0};
+    std::atomic<size_t> bulkShed{0};
+    std::atomic<size_t> slowConsumersDropped{0};
+    std::atomic<size_t> audioRelayed{0};
+    std::atomic<size_t> audioLate{0};
+    std::atomic<size_t> audioOverflow{0};
+    std::atomic<size_t> logDropped{0};
+    std::atomic<size_t> clusterForwarded{0};
+    std::atomic<size_t> clusterDelivered{0};
+    std::atomic<size_t> clusterDropped{0};
+    std::atomic<size_t> clusterRebalances{0};
+    std::atomic<size_t> unknownPackets{0};
+    std::atomic<size_t> busPublished{0};
+    std::atomic<size_t> busReceived{0};
+    std::atomic<size_t> busLost{0};
+    std::atomic<size_t> controlRequests{0};
+    std::atomic<uint64_t> controlMicros{0};
+    std::atomic<uint64_t> controlMaxMicros{0};
+    std::atomic<size_t> controlOverMs{0};
+    std::atomic<size_t> bulkQueued{0};
+    std::atomic<uint64_t> bulkWaitMicros{0};
+    std::atomic<uint64_t> bulkMaxWaitMicros{0};
+    std::atomic<size_t> recvCalls{0};
+    std::atomic<size_t> packetsReceived{0};
+    std::atomic<uint64_t> attachBytesIn{0};
+    std::atomic<uint64_t> attachSpliced{0};
+    std::atomic<uint64_t> attachBytesOut{0};
+    std::atomic<size_t> attachStored{0};
+    std::atomic<size_t> historyPackets{0};
+    std::atomic<size_t> historyDeltas{0};
+    std::atomic<size_t> historyGaps{0};
     size_t activeThreads;
     std::mutex mtx;
+    std::mutex fanoutMtx;
+    std::map<uint16_t, FanoutStats> fanoutStats;
+    // Fixed-size sketches (128 monitored keys, 4 x 2048 counters each)
+    GroupHitters hotGroups{128, 2048, 4, TRAFFIC_HALF_LIFE};
+    SenderHitters noisySenders{128, 2048, 4, TRAFFIC_HALF_LIFE};
+    GroupHitters fanoutBytes{128, 2048, 4, TRAFFIC_HALF_LIFE};
+    std::vector<ThreadInfo> threads;     // guarded by mtx
+    std::vector<CoreTimes> startCores;   // /proc/stat at startup
 };
@@ -1,30 +1,86 @@
 // shared/protocol.h
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <string>
 #include <chrono>
+#include <type_traits>
 #include <arpa/inet.h> // htons, htonl, ntohs, ntohl
+#include <endian.h>    // htobe64, be64toh
 
 // Message types
 enum MessageType : uint8_t {
     MSG_JOIN        = 1,
     MSG_TEXT        = 2,
     MSG_SWITCH      = 3,
-    MSG_LIST_GROUPS = 4
+    MSG_LIST_GROUPS = 4,
+    MSG_AUDIO_JOIN  = 5,  // switch this connection to audio relay framing
+    MSG_SEARCH      = 6,  // request: payload = query; reply: one match each
+    MSG_SEARCH_DONE = 7,  // end of search results, payload = summary
+    MSG_FIND        = 8,  // indexed word/sender query, answered like MSG_SEARCH
+
+    // Attachments (payloads are space-separated text fields; a reply
+    // payload starting with "ERR " reports a failure)
+    MSG_ATTACH_OFFER = 9,  // c->s "<sha256> <size> <name>"; reply "<sha256> <stored>"
+    MSG_ATTACH_CHUNK = 10, // c->s "<sha256> <offset> <length>" + `length` raw bytes
+    MSG_ATTACH_GET   = 11, // c->s "<sha256> <offset> <length>"
+    MSG_ATTACH_DATA  = 12, // s->c "<sha256> <offset> <length> <size>" + `length` raw bytes
+    MSG_ATTACHMENT   = 13, // s->group "<sha256> <size> <name>" once an upload completes
+
+    // Receive more groups on the same connection. Payload: group ids
+    // ("2 3 7"), or empty for pkt.groupID. The reply carries the groups
+    // now received, after one batch of history for the new ones.
+    MSG_SUBSCRIBE    = 14,
+    MSG_UNSUBSCRIBE  = 15,
+
+    // Heavy hitters: answered with one MSG_TOP per list (hot groups,
+    // noisy senders, fan-out bytes), payload "<title>: <key> <n>, ..."
+    MSG_TOP          = 16,
+
+    // Sent before the history for a JOIN/SWITCH whose `seq` the server
+    // cannot continue from (messages after it are gone, or the group's
+    // sequence restarted: `epoch` differs). Payload "<since> <next>":
+    // the history that follows starts at `next`, not at since + 1.
+    MSG_HISTORY_GAP  = 17
 };
 
-// NOTE: raw struct that will be sent over the wire as bytes
+// Raw bytes per MSG_ATTACH_CHUNK / MSG_ATTACH_DATA. Chat packets for the
+// same connection wait at most one chunk behind a transfer.
+constexpr uint32_t MAX_ATTACH_CHUNK = 256 * 1024;
+constexpr uint64_t MAX_ATTACHMENT   = 64ull * 1024 * 1024;
+
+// Also sent as raw struct bytes (after to_network), so every padding
+// byte is an explicit, zeroed field and the layout is pinned below.
+// shared/wire.h encodes the same layout field by field.
 struct ChatPacket {
     uint8_t  type;          // MessageType
+    uint8_t  reserved0;     // padding, zero
     uint16_t groupID;       // group id
     uint16_t senderID;      // client socket/ID
+    uint16_t epoch;         // incarnation of the group numbering `seq` is from;
+                            // echoed with it on JOIN/SWITCH
     uint32_t timestamp;     // unix time
+    uint32_t seq;           // per-group sequence of a cached message, 0 if none;
+                            // on JOIN/SWITCH, the last one the client has seen
     char     senderName[32];// username
     char     payload[224];  // text content (reduced to fit senderName)
 };
 
+static_assert(std::is_trivially_copyable<ChatPacket>::value &&
+              std::is_standard_layout<ChatPacket>::value,
+              "ChatPacket is copied as raw bytes");
+static_assert(sizeof(ChatPacket) == 272, "ChatPacket wire size");
+static_assert(offsetof(ChatPacket, groupID) == 2 &&
+              offsetof(ChatPacket, senderID) == 4 &&
+              offsetof(ChatPacket, epoch) == 6 &&
+              offsetof(ChatPacket, timestamp) == 8 &&
+              offsetof(ChatPacket, seq) == 12 &&
+              offsetof(ChatPacket, senderName) == 16 &&
+              offsetof(ChatPacket, payload) == 48,
+              "ChatPacket wire offsets");
+
 // Get current timestamp (seconds since epoch)
 inline uint32_t current_timestamp() {
     using namespace std::chrono;
@@ -51,12 +107,32 @@ inline ChatPacket make_packet(MessageType type,
     return pkt;
 }
 
+// A client's place in a group's numbering: the last message it saw,
+// echoed in the seq/epoch of its JOIN/SWITCH for that group
+struct SeenPosition {
+    uint32_t seq = 0;
+    uint16_t epoch = 0;
+
+    // Fed every numbered message in arrival order; one from a new epoch
+    // restarts the count
+    void advance(const ChatPacket &pkt) {
+        if (pkt.epoch != epoch) {
+            epoch = pkt.epoch;
+            seq = pkt.seq;
+        } else if (pkt.seq > seq) {
+            seq = pkt.seq;
+        }
+    }
+};
+
 // Convert host-order packet to network-order fields for sending
 inline ChatPacket to_network(const ChatPacket &hostPkt) {
     ChatPacket net = hostPkt;
     net.groupID    = htons(hostPkt.groupID);
     net.senderID   = htons(hostPkt.senderID);
+    net.epoch      = htons(hostPkt.epoch);
     net.timestamp  = htonl(hostPkt.timestamp);
+    net.seq        = htonl(hostPkt.seq);
     return net;
 }
 
@@ -65,7 +141,56 @@ inline ChatPacket to_host(const ChatPacket &netPkt) {
     ChatPacket host = netPkt;
     host.groupID    = ntohs(netPkt.groupID);
     host.senderID   = ntohs(netPkt.senderID);
+    host.epoch      = ntohs(netPkt.epoch);
     host.timestamp  = ntohl(netPkt.timestamp);
+    host.seq        = ntohl(netPkt.seq);
     return host;
 }
 
+
+// ===== Audio relay framing =====
+// After MSG_AUDIO_JOIN the connection stops carrying ChatPackets and
+// carries AudioFrameHeader + `length` bytes of audio in both directions.
+
+constexpr uint32_t MAX_AUDIO_PAYLOAD = 4096;
+
+struct AudioFrameHeader {
+    uint32_t seq;           // per-stream sequence number
+    uint32_t length;        // payload bytes following the header
+    uint64_t captureMicros; // sender wall clock, microseconds since epoch
+    uint16_t groupID;       // audio group
+    uint16_t streamID;      // assigned by the server (sender socket)
+    uint32_t reserved;      // keeps the header a multiple of 8 bytes
+};
+
+static_assert(sizeof(AudioFrameHeader) == 24 &&
+              offsetof(AudioFrameHeader, captureMicros) == 8 &&
+              offsetof(AudioFrameHeader, groupID) == 16,
+              "AudioFrameHeader wire layout");
+
+// Wall clock in microseconds, used to stamp audio frames
+inline uint64_t current_micros() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(
+        system_clock::now().time_since_epoch()).count();
+}
+
+inline AudioFrameHeader to_network(const AudioFrameHeader &h) {
+    AudioFrameHeader net = h;
+    net.seq           = htonl(h.seq);
+    net.length        = htonl(h.length);
+    net.captureMicros = htobe64(h.captureMicros);
+    net.groupID       = htons(h.groupID);
+    net.streamID      = htons(h.streamID);
+    return net;
+}
+
+inline AudioFrameHeader to_host(const AudioFrameHeader &net) {
+    AudioFrameHeader h = net;
+    h.seq           = ntohl(net.seq);
+    h.length        = ntohl(net.length);
+    h.captureMicros = be64toh(net.captureMicros);
+    h.groupID       = ntohs(net.groupID);
+    h.streamID      = ntohs(net.streamID);
+    return h;
+}
@@ -0,0 +1,25 @@
+// shared/recv_buffer.cpp
+#include "recv_buffer.h"
+#include <sys/socket.h>
+#include <cerrno>
+#include <cstring>
+
+RecvBuffer::RecvBuffer(size_t frameSize, size_t capacity)
+    : frameSize(frameSize),
+      buf(capacity < frameSize ? frameSize : capacity) { }
+
+ssize_t RecvBuffer::fill(int fd) {
+    // Move a partial frame to the front once it could no longer complete
+    if (buf.size() - end < frameSize) {
+        std::memmove(buf.data(), buf.data() + start, end - start);
+        end -= start;
+        start = 0;
+    }
+
+    while (true) {
+        ssize_t n = recv(fd, buf.data() + end, buf.size() - end, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n > 0) end += n;
+        return n;
+    }
+}
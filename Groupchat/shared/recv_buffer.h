@@ -0,0 +1,57 @@
+// shared/recv_buffer.h
+#pragma once
+
+#include <sys/types.h>
+#include <cstddef>
+#include <vector>
+
+// Per-connection receive buffer for fixed-size frames. fill() does one
+// recv() of up to the free space, so a burst of packets arrives in one
+// syscall; drain() hands out every complete frame in place and keeps a
+// trailing partial frame for the next fill(). A frame split across TCP
+// segments is reassembled, never decoded half-filled.
+class RecvBuffer {
+public:
+    explicit RecvBuffer(size_t frameSize, size_t capacity = 64 * 1024);
+
+    // >0 bytes read, 0 on EOF, -1 on error (EINTR is retried)
+    ssize_t fill(int fd);
+
+    // Calls fn(const unsigned char *frame) per complete frame, stopping
+    // early once it returns false. Frames are valid until the next fill().
+    // Returns the number of frames handed out.
+    template <typename Fn>
+    size_t drain(Fn &&fn) {
+        size_t frames = 0;
+        while (end - start >= frameSize) {
+            const unsigned char *frame = buf.data() + start;
+            start += frameSize;
+            ++frames;
+            if (!fn(frame)) break;
+        }
+        if (start == end) start = end = 0;
+        return frames;
+    }
+
+    // Raw bytes that follow the last frame handed out, for a frame that
+    // announces a body of its own. Points `data` at up to `max` buffered
+    // bytes and consumes them; whatever is missing is still in the socket.
+    size_t takeRaw(size_t max, const unsigned char *&data) {
+        size_t n = end - start < max ? end - start : max;
+        data = buf.data() + start;
+        start += n;
+        return n;
+    }
+
+    // Bytes received but not yet handed out as a frame
+    size_t pending() const { return end - start; }
+
+    // Forget everything buffered, e.g. after reconnecting
+    void reset() { start = end = 0; }
+
+private:
+    size_t frameSize;
+    std::vector<unsigned char> buf;
+    size_t start = 0;  // first unconsumed byte
+    size_t end = 0;    // one past the last received byte
+};
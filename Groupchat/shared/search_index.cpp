@@ -0,0 +1,572 @@
+// shared/search_index.cpp
+#include "search_index.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+using namespace IndexFormat;
+
+namespace {
+
+void putVarint(std::string &out, uint32_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+// Ids are ascending, so decoding stops at the first one that is not a
+// doc of the segment (docCount); a corrupt list can't index past it
+void decodePostings(const uint8_t *p, const uint8_t *end, uint32_t count,
+                    uint32_t docCount, std::vector<uint32_t> &out) {
+    out.clear();
+    out.reserve(std::min(count, docCount));
+    uint64_t doc = 0;
+    while (p < end && out.size() < count) {
+        uint64_t delta = 0;
+        int shift = 0;
+        while (p < end) {
+            uint8_t b = *p++;
+            if (shift < 64) delta |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) break;
+            shift += 7;
+        }
+        doc += delta;
+        if (doc >= docCount) break;
+        out.push_back(static_cast<uint32_t>(doc));
+    }
+}
+
+size_t align8(size_t n) {
+    return (n + 7) & ~static_cast<size_t>(7);
+}
+
+// Intersect every term's postings in one segment; hits newest first
+template <typename Seg>
+void querySegment(const Seg &seg, const std::vector<std::string> &terms,
+                  uint16_t groupID, size_t limit, std::vector<IndexHit> &out) {
+    std::vector<std::vector<uint32_t>> lists(terms.size());
+    for (size_t i = 0; i < terms.size(); ++i) {
+        seg.lookup(terms[i], lists[i]);
+        if (lists[i].empty()) return;
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const std::vector<uint32_t> &a, const std::vector<uint32_t> &b) {
+                  return a.size() < b.size();
+              });
+
+    std::vector<uint32_t> result = std::move(lists[0]);
+    std::vector<uint32_t> tmp;
+    for (size_t i = 1; i < lists.size() && !result.empty(); ++i) {
+        tmp.clear();
+        std::set_intersection(result.begin(), result.end(),
+                              lists[i].begin(), lists[i].end(),
+                              std::back_inserter(tmp));
+        result.swap(tmp);
+    }
+
+    for (auto it = result.rbegin(); it != result.rend() && out.size() < limit; ++it) {
+        if (groupID && seg.docGroup(*it) != groupID) continue;
+        out.push_back(seg.hit(*it));
+    }
+}
+
+} // namespace
+
+// ===== IndexFormat =====
+
+void IndexFormat::tokenize(const char *text, size_t len, std::vector<std::string> &out) {
+    constexpr size_t MAX_TERM = 32;
+    std::string word;
+    for (size_t i = 0; i <= len; ++i) {
+        char c = i < len ? text[i] : ' ';
+        bool alnum = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+                     (c >= 'A' && c <= 'Z');
+        if (alnum) {
+            if (word.size() < MAX_TERM) word += static_cast<char>(c | (c >= 'A' && c <= 'Z' ? 0x20 : 0));
+        } else {
+            if (word.size() >= 2) out.push_back(word);
+            word.clear();
+        }
+    }
+}
+
+std::string IndexFormat::senderTerm(const char *name, size_t len) {
+    std::string term = "@";
+    for (size_t i = 0; i < len; ++i) {
+        char c = name[i];
+        term += (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+    }
+    return term;
+}
+
+// ===== SegmentWriter =====
+
+uint32_t SegmentWriter::addDoc(uint16_t groupID, uint32_t seq, uint32_t timestamp,
+                               const char *sender, size_t senderLen,
+                               const char *body, size_t bodyLen) {
+    senderLen = std::min<size_t>(senderLen, 255);
+    bodyLen   = std::min<size_t>(bodyLen, 255);
+
+    DocRecord d{};
+    d.groupID    = groupID;
+    d.senderLen  = static_cast<uint8_t>(senderLen);
+    d.textLen    = static_cast<uint8_t>(bodyLen);
+    d.seq        = seq;
+    d.timestamp  = timestamp;
+    d.textOffset = static_cast<uint32_t>(text.size());
+    text.append(sender, senderLen);
+    text.append(body, bodyLen);
+    docs.push_back(d);
+    return static_cast<uint32_t>(docs.size() - 1);
+}
+
+void SegmentWriter::addTerm(const std::string &term, const std::vector<uint32_t> &ids) {
+    TermEntry e{};
+    e.strOffset      = static_cast<uint32_t>(strings.size());
+    e.strLen         = static_cast<uint32_t>(term.size());
+    e.postingsOffset = postings.size();
+    e.docFreq        = static_cast<uint32_t>(ids.size());
+    strings += term;
+
+    uint32_t prev = 0;
+    for (uint32_t id : ids) {
+        putVarint(postings, id - prev);
+        prev = id;
+    }
+    e.postingsBytes = static_cast<uint32_t>(postings.size() - e.postingsOffset);
+    terms.push_back(e);
+}
+
+bool SegmentWriter::write(const std::string &path) const {
+    SegmentHeader h{};
+    std::memcpy(h.magic, MAGIC, sizeof(h.magic));
+    h.docCount       = static_cast<uint32_t>(docs.size());
+    h.termCount      = static_cast<uint32_t>(terms.size());
+    h.docsOffset     = align8(sizeof(SegmentHeader));
+    h.termsOffset    = align8(h.docsOffset + docs.size() * sizeof(DocRecord));
+    h.stringsOffset  = align8(h.termsOffset + terms.size() * sizeof(TermEntry));
+    h.postingsOffset = align8(h.stringsOffset + strings.size());
+    h.textOffset     = align8(h.postingsOffset + postings.size());
+    h.fileSize       = h.textOffset + text.size();
+
+    // Write beside the target and rename so readers never see half a file
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    auto padTo = [&out](uint64_t offset) {
+        static const char zeros[8] = {};
+        uint64_t pos = static_cast<uint64_t>(out.tellp());
+        if (offset > pos) out.write(zeros, offset - pos);
+    };
+
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    padTo(h.docsOffset);
+    out.write(reinterpret_cast<const char*>(docs.data()), docs.size() * sizeof(DocRecord));
+    padTo(h.termsOffset);
+    out.write(reinterpret_cast<const char*>(terms.data()), terms.size() * sizeof(TermEntry));
+    padTo(h.stringsOffset);
+    out.write(strings.data(), strings.size());
+    padTo(h.postingsOffset);
+    out.write(postings.data(), postings.size());
+    padTo(h.textOffset);
+    out.write(text.data(), text.size());
+    out.close();
+    if (!out) return false;
+
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// ===== SegmentBuilder =====
+
+void SegmentBuilder::add(uint16_t groupID, uint32_t seq, uint32_t timestamp,
+                         const char *sender, size_t senderLen,
+                         const char *body, size_t bodyLen) {
+    senderLen = std::min<size_t>(senderLen, 255);
+    bodyLen   = std::min<size_t>(bodyLen, 255);
+
+    uint32_t doc = static_cast<uint32_t>(docs.size());
+    DocRecord d{};
+    d.groupID    = groupID;
+    d.senderLen  = static_cast<uint8_t>(senderLen);
+    d.textLen    = static_cast<uint8_t>(bodyLen);
+    d.seq        = seq;
+    d.timestamp  = timestamp;
+    d.textOffset = static_cast<uint32_t>(text.size());
+    text.append(sender, senderLen);
+    text.append(body, bodyLen);
+    docs.push_back(d);
+
+    std::vector<std::string> words;
+    tokenize(body, bodyLen, words);
+    words.push_back(senderTerm(sender, senderLen));
+    for (const auto &w : words) {
+        auto &list = postings[w];
+        if (list.empty() || list.back() != doc) list.push_back(doc);
+    }
+}
+
+bool SegmentBuilder::write(const std::string &path) const {
+    SegmentWriter w;
+    for (const auto &d : docs) {
+        const char *t = text.data() + d.textOffset;
+        w.addDoc(d.groupID, d.seq, d.timestamp, t, d.senderLen,
+                 t + d.senderLen, d.textLen);
+    }
+
+    std::vector<const std::string*> keys;
+    keys.reserve(postings.size());
+    for (const auto &p : postings) keys.push_back(&p.first);
+    std::sort(keys.begin(), keys.end(),
+              [](const std::string *a, const std::string *b) { return *a < *b; });
+    for (const auto *k : keys) w.addTerm(*k, postings.at(*k));
+
+    return w.write(path);
+}
+
+void SegmentBuilder::clear() {
+    docs.clear();
+    text.clear();
+    postings.clear();
+}
+
+void SegmentBuilder::lookup(const std::string &term, std::vector<uint32_t> &out) const {
+    auto it = postings.find(term);
+    if (it == postings.end()) {
+        out.clear();
+    } else {
+        out = it->second;
+    }
+}
+
+IndexHit SegmentBuilder::hit(uint32_t doc) const {
+    const DocRecord &d = docs[doc];
+    const char *t = text.data() + d.textOffset;
+    return IndexHit{d.groupID, d.seq, d.timestamp,
+                    std::string(t, d.senderLen),
+                    std::string(t + d.senderLen, d.textLen)};
+}
+
+// ===== Segment =====
+
+std::unique_ptr<Segment> Segment::open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SegmentHeader)) {
+        close(fd);
+        return nullptr;
+    }
+
+    void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return nullptr;
+
+    std::unique_ptr<Segment> seg(new Segment());
+    seg->filePath = path;
+    seg->base = base;
+    seg->size = st.st_size;
+    seg->header = static_cast<const SegmentHeader*>(base);
+
+    const SegmentHeader &h = *seg->header;
+    bool valid = std::memcmp(h.magic, MAGIC, sizeof(h.magic)) == 0 &&
+                 h.fileSize == seg->size &&
+                 h.docsOffset + (uint64_t)h.docCount * sizeof(DocRecord) <= h.termsOffset &&
+                 h.termsOffset + (uint64_t)h.termCount * sizeof(TermEntry) <= h.stringsOffset &&
+                 h.stringsOffset <= h.postingsOffset &&
+                 h.postingsOffset <= h.textOffset &&
+                 h.textOffset <= h.fileSize &&
+                 h.docsOffset % alignof(DocRecord) == 0 &&
+                 h.termsOffset % alignof(TermEntry) == 0;
+    if (!valid) return nullptr;
+
+    const char *bytes = static_cast<const char*>(base);
+    seg->docs  = reinterpret_cast<const DocRecord*>(bytes + h.docsOffset);
+    seg->terms = reinterpret_cast<const TermEntry*>(bytes + h.termsOffset);
+
+    // Every record must stay inside its own section, so lookups and
+    // hits on a truncated or corrupt file never read past the mapping
+    uint64_t stringsBytes  = h.postingsOffset - h.stringsOffset;
+    uint64_t postingsBytes = h.textOffset - h.postingsOffset;
+    uint64_t textBytes     = h.fileSize - h.textOffset;
+    for (uint32_t i = 0; i < h.termCount; ++i) {
+        const TermEntry &t = seg->terms[i];
+        if ((uint64_t)t.strOffset + t.strLen > stringsBytes ||
+            t.postingsOffset > postingsBytes ||
+            t.postingsBytes > postingsBytes - t.postingsOffset)
+            return nullptr;
+    }
+    for (uint32_t i = 0; i < h.docCount; ++i) {
+        const DocRecord &d = seg->docs[i];
+        if ((uint64_t)d.textOffset + d.senderLen + d.textLen > textBytes) return nullptr;
+    }
+    return seg;
+}
+
+Segment::~Segment() {
+    if (base) munmap(base, size);
+}
+
+std::string Segment::term(size_t i) const {
+    const char *strings = static_cast<const char*>(base) + header->stringsOffset;
+    return std::string(strings + terms[i].strOffset, terms[i].strLen);
+}
+
+void Segment::postings(size_t i, std::vector<uint32_t> &out) const {
+    const uint8_t *p = static_cast<const uint8_t*>(base) + header->postingsOffset
+                       + terms[i].postingsOffset;
+    decodePostings(p, p + terms[i].postingsBytes, terms[i].docFreq, header->docCount, out);
+}
+
+void Segment::lookup(const std::string &term, std::vector<uint32_t> &out) const {
+    const char *strings = static_cast<const char*>(base) + header->stringsOffset;
+
+    size_t lo = 0, hi = header->termCount;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const TermEntry &e = terms[mid];
+        int cmp = std::memcmp(strings + e.strOffset, term.data(),
+                              std::min<size_t>(e.strLen, term.size()));
+        if (cmp == 0) cmp = (e.strLen < term.size()) ? -1 : (e.strLen > term.size());
+        if (cmp == 0) {
+            postings(mid, out);
+            return;
+        }
+        if (cmp < 0) lo = mid + 1; else hi = mid;
+    }
+    out.clear();
+}
+
+const char *Segment::docText(const DocRecord &d) const {
+    return static_cast<const char*>(base) + header->textOffset + d.textOffset;
+}
+
+IndexHit Segment::hit(uint32_t doc) const {
+    const DocRecord &d = docs[doc];
+    const char *t = docText(d);
+    return IndexHit{d.groupID, d.seq, d.timestamp,
+                    std::string(t, d.senderLen),
+                    std::string(t + d.senderLen, d.textLen)};
+}
+
+// ===== Merge =====
+
+bool mergeSegments(const std::vector<const Segment*> &inputs,
+                   const std::string &outPath) {
+    SegmentWriter w;
+    std::vector<uint32_t> bases;
+
+    for (const Segment *seg : inputs) {
+        bases.push_back(0);
+        bool first = true;
+        for (size_t i = 0; i < seg->docCount(); ++i) {
+            const DocRecord &d = seg->doc(i);
+            const char *t = seg->docText(d);
+            uint32_t id = w.addDoc(d.groupID, d.seq, d.timestamp, t, d.senderLen,
+                                   t + d.senderLen, d.textLen);
+            if (first) {
+                bases.back() = id;
+                first = false;
+            }
+        }
+    }
+
+    // Every segment's term table is sorted; walk them in term order and
+    // concatenate postings with each segment's doc id offset
+    std::map<std::string, std::vector<std::pair<size_t, size_t>>> termRefs;
+    for (size_t s = 0; s < inputs.size(); ++s) {
+        for (size_t t = 0; t < inputs[s]->termCount(); ++t)
+            termRefs[inputs[s]->term(t)].emplace_back(s, t);
+    }
+
+    std::vector<uint32_t> merged, part;
+    for (const auto &entry : termRefs) {
+        merged.clear();
+        for (const auto &ref : entry.second) {
+            inputs[ref.first]->postings(ref.second, part);
+            for (uint32_t doc : part) merged.push_back(bases[ref.first] + doc);
+        }
+        w.addTerm(entry.first, merged);
+    }
+
+    return w.write(outPath);
+}
+
+// ===== SearchIndex =====
+
+SearchIndex::SearchIndex(const std::string &dir, bool background)
+    : dir(dir) {
+    loadSegments();
+    if (background) {
+        indexer = std::thread(&SearchIndex::indexerLoop, this);
+    }
+}
+
+SearchIndex::~SearchIndex() {
+    if (indexer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(pendingMtx);
+            stopping = true;
+        }
+        pendingCv.notify_one();
+        indexer.join();
+    }
+    flush();
+}
+
+void SearchIndex::loadSegments() {
+    mkdir(dir.c_str(), 0755);
+
+    std::vector<std::string> names;
+    if (DIR *d = opendir(dir.c_str())) {
+        while (dirent *ent = readdir(d)) {
+            // seg_<number>.idx
+            std::string name = ent->d_name;
+            if (name.size() <= 8 || name.compare(0, 4, "seg_") != 0 ||
+                name.compare(name.size() - 4, 4, ".idx") != 0)
+                continue;
+            uint32_t id = static_cast<uint32_t>(std::strtoul(name.c_str() + 4, nullptr, 10));
+            names.push_back(name);
+            nextSegmentId = std::max(nextSegmentId, id + 1);
+        }
+        closedir(d);
+    }
+    std::sort(names.begin(), names.end());
+
+    for (const auto &name : names) {
+        auto seg = Segment::open(dir + "/" + name);
+        if (!seg) continue;
+        segments.push_back(std::move(seg));
+    }
+}
+
+std::string SearchIndex::nextSegmentPath() {
+    char name[32];
+    std::snprintf(name, sizeof(name), "seg_%06u.idx", nextSegmentId++);
+    return dir + "/" + name;
+}
+
+void SearchIndex::add(uint16_t groupID, const ChatPacket &pkt) {
+    if (!indexer.joinable()) {
+        addNow(groupID, pkt.seq, pkt.timestamp,
+               pkt.senderName, strnlen(pkt.senderName, sizeof(pkt.senderName)),
+               pkt.payload, strnlen(pkt.payload, sizeof(pkt.payload)));
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pendingMtx);
+        if (pending.size() >= MAX_PENDING) {
+            droppedDocs.fetch_add(1);
+            return;
+        }
+        pending.push_back(Pending{groupID, pkt});
+    }
+    pendingCv.notify_one();
+}
+
+void SearchIndex::addNow(uint16_t groupID, uint32_t seq, uint32_t timestamp,
+                         const char *sender, size_t senderLen,
+                         const char *text, size_t textLen) {
+    std::lock_guard<std::mutex> lock(mtx);
+    addLocked(groupID, seq, timestamp, sender, senderLen, text, textLen);
+}
+
+void SearchIndex::addLocked(uint16_t groupID, uint32_t seq, uint32_t timestamp,
+                            const char *sender, size_t senderLen,
+                            const char *text, size_t textLen) {
+    active.add(groupID, seq, timestamp, sender, senderLen, text, textLen);
+    if (active.docCount() >= SEAL_DOCS) sealLocked();
+}
+
+void SearchIndex::indexerLoop() {
+    std::deque<Pending> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(pendingMtx);
+            pendingCv.wait(lock, [this]() { return stopping || !pending.empty(); });
+            if (pending.empty() && stopping) return;
+            batch.swap(pending);
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        for (const auto &p : batch) {
+            addLocked(p.groupID, p.pkt.seq, p.pkt.timestamp,
+                      p.pkt.senderName, strnlen(p.pkt.senderName, sizeof(p.pkt.senderName)),
+                      p.pkt.payload, strnlen(p.pkt.payload, sizeof(p.pkt.payload)));
+        }
+        batch.clear();
+    }
+}
+
+void SearchIndex::sealLocked() {
+    if (active.docCount() == 0) return;
+    std::string path = nextSegmentPath();
+    if (active.write(path)) {
+        if (auto seg = Segment::open(path)) segments.push_back(std::move(seg));
+    }
+    active.clear();
+}
+
+void SearchIndex::flush() {
+    std::lock_guard<std::mutex> lock(mtx);
+    sealLocked();
+}
+
+bool SearchIndex::compact() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (segments.size() < 2) return true;
+
+    std::vector<const Segment*> inputs;
+    for (const auto &s : segments) inputs.push_back(s.get());
+
+    std::string path = nextSegmentPath();
+    if (!mergeSegments(inputs, path)) return false;
+    auto merged = Segment::open(path);
+    if (!merged) return false;
+
+    for (const auto &s : segments) unlink(s->path().c_str());
+    segments.clear();
+    segments.push_back(std::move(merged));
+    return true;
+}
+
+std::vector<IndexHit> SearchIndex::query(const std::vector<std::string> &words,
+                                         const std::string &sender,
+                                         uint16_t groupID, size_t limit) {
+    std::vector<std::string> terms;
+    for (const auto &w : words) tokenize(w.data(), w.size(), terms);
+    if (!sender.empty()) terms.push_back(senderTerm(sender.data(), sender.size()));
+
+    std::vector<IndexHit> hits;
+    if (terms.empty()) return hits;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    querySegment(active, terms, groupID, limit, hits);
+    for (auto it = segments.rbegin(); it != segments.rend() && hits.size() < limit; ++it)
+        querySegment(**it, terms, groupID, limit, hits);
+    return hits;
+}
+
+size_t SearchIndex::docCount() {
+    std::lock_guard<std::mutex> lock(mtx);
+    size_t n = active.docCount();
+    for (const auto &s : segments) n += s->docCount();
+    return n;
+}
+
+size_t SearchIndex::segmentCount() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return segments.size();
+}
@@ -0,0 +1,217 @@
+// shared/search_index.h
+#pragma once
+
+#include "protocol.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Inverted index over chat messages. Postings map a term (lowercase
+// word, or "@sender") to the ids of the messages containing it; each
+// message record carries its group and the per-group sequence number
+// the cache assigned it (ChatPacket::seq).
+//
+// New messages go into an in-memory SegmentBuilder. Once it holds
+// SEAL_DOCS messages it is written out as an immutable segment file:
+// fixed-size records and offsets only, so it is used straight from mmap.
+// Posting lists are delta + varint encoded. Segments can be merged
+// offline (see tools/index_tool.cpp).
+
+struct IndexHit {
+    uint16_t groupID;
+    uint32_t seq;
+    uint32_t timestamp;
+    std::string sender;
+    std::string text;
+};
+
+namespace IndexFormat {
+
+constexpr char MAGIC[8] = {'G', 'C', 'I', 'D', 'X', '0', '0', '1'};
+
+struct SegmentHeader {
+    char     magic[8];
+    uint32_t docCount;
+    uint32_t termCount;
+    uint64_t docsOffset;      // DocRecord[docCount]
+    uint64_t termsOffset;     // TermEntry[termCount], sorted by term
+    uint64_t stringsOffset;   // term bytes
+    uint64_t postingsOffset;  // varint-encoded doc id deltas
+    uint64_t textOffset;      // sender + payload bytes per doc
+    uint64_t fileSize;
+};
+
+struct DocRecord {
+    uint16_t groupID;
+    uint8_t  senderLen;
+    uint8_t  textLen;
+    uint32_t seq;
+    uint32_t timestamp;
+    uint32_t textOffset;      // sender bytes, then payload bytes
+};
+
+struct TermEntry {
+    uint32_t strOffset;
+    uint32_t strLen;
+    uint64_t postingsOffset;
+    uint32_t postingsBytes;
+    uint32_t docFreq;
+};
+
+static_assert(sizeof(SegmentHeader) == 64, "segment header layout");
+static_assert(sizeof(DocRecord) == 16, "doc record layout");
+static_assert(sizeof(TermEntry) == 24, "term entry layout");
+
+// Lowercase alphanumeric words of at least two characters
+void tokenize(const char *text, size_t len, std::vector<std::string> &out);
+std::string senderTerm(const char *name, size_t len);
+
+} // namespace IndexFormat
+
+// Accumulates documents and sorted terms, then writes one segment file
+class SegmentWriter {
+public:
+    uint32_t addDoc(uint16_t groupID, uint32_t seq, uint32_t timestamp,
+                    const char *sender, size_t senderLen,
+                    const char *text, size_t textLen);
+    // Terms must be added in ascending order; docs ascending within a term
+    void addTerm(const std::string &term, const std::vector<uint32_t> &docs);
+    bool write(const std::string &path) const;
+
+private:
+    std::vector<IndexFormat::DocRecord> docs;
+    std::string text;
+    std::vector<IndexFormat::TermEntry> terms;
+    std::string strings;
+    std::string postings;
+};
+
+// The mutable in-memory segment
+class SegmentBuilder {
+public:
+    void add(uint16_t groupID, uint32_t seq, uint32_t timestamp,
+             const char *sender, size_t senderLen,
+             const char *text, size_t textLen);
+
+    size_t docCount() const { return docs.size(); }
+    bool write(const std::string &path) const;
+    void clear();
+
+    void lookup(const std::string &term, std::vector<uint32_t> &out) const;
+    uint16_t docGroup(uint32_t doc) const { return docs[doc].groupID; }
+    uint32_t docSeq(uint32_t doc) const { return docs[doc].seq; }
+    IndexHit hit(uint32_t doc) const;
+
+private:
+    std::vector<IndexFormat::DocRecord> docs;
+    std::string text;
+    std::unordered_map<std::string, std::vector<uint32_t>> postings;
+};
+
+// An immutable segment file mapped read-only
+class Segment {
+public:
+    static std::unique_ptr<Segment> open(const std::string &path);
+    ~Segment();
+
+    Segment(const Segment &) = delete;
+    Segment &operator=(const Segment &) = delete;
+
+    const std::string &path() const { return filePath; }
+    size_t docCount() const { return header->docCount; }
+    size_t termCount() const { return header->termCount; }
+
+    void lookup(const std::string &term, std::vector<uint32_t> &out) const;
+    uint16_t docGroup(uint32_t doc) const { return docs[doc].groupID; }
+    uint32_t docSeq(uint32_t doc) const { return docs[doc].seq; }
+    IndexHit hit(uint32_t doc) const;
+
+    // Raw access used by mergeSegments
+    std::string term(size_t i) const;
+    void postings(size_t i, std::vector<uint32_t> &out) const;
+    const IndexFormat::DocRecord &doc(size_t i) const { return docs[i]; }
+    const char *docText(const IndexFormat::DocRecord &d) const;
+
+private:
+    Segment() = default;
+
+    std::string filePath;
+    void *base = nullptr;
+    size_t size = 0;
+    const IndexFormat::SegmentHeader *header = nullptr;
+    const IndexFormat::DocRecord *docs = nullptr;
+    const IndexFormat::TermEntry *terms = nullptr;
+};
+
+// Combine segments (oldest first) into one file at outPath
+bool mergeSegments(const std::vector<const Segment*> &inputs,
+                   const std::string &outPath);
+
+class SearchIndex {
+public:
+    static constexpr size_t SEAL_DOCS   = 50000;   // docs per segment
+    static constexpr size_t MAX_PENDING = 100000;  // queued before dropping
+
+    // background = false indexes synchronously in add() (offline tools)
+    explicit SearchIndex(const std::string &dir, bool background = true);
+    ~SearchIndex();
+
+    // Called on every broadcast; cheap, the indexing happens later
+    void add(uint16_t groupID, const ChatPacket &pkt);
+
+    // Index one message now (used when rebuilding from the chat log)
+    void addNow(uint16_t groupID, uint32_t seq, uint32_t timestamp,
+                const char *sender, size_t senderLen,
+                const char *text, size_t textLen);
+
+    // Newest-first messages containing every word and, if sender is
+    // non-empty, sent by that user. groupID 0 searches every group.
+    std::vector<IndexHit> query(const std::vector<std::string> &words,
+                                const std::string &sender,
+                                uint16_t groupID, size_t limit);
+
+    // Seal the in-memory segment to disk
+    void flush();
+
+    // Merge every sealed segment into one
+    bool compact();
+
+    size_t docCount();
+    size_t segmentCount();
+    size_t dropped() const { return droppedDocs.load(); }
+
+private:
+    struct Pending {
+        uint16_t groupID;
+        ChatPacket pkt;
+    };
+
+    void loadSegments();
+    void indexerLoop();
+    void addLocked(uint16_t groupID, uint32_t seq, uint32_t timestamp,
+                   const char *sender, size_t senderLen,
+                   const char *text, size_t textLen);
+    void sealLocked();
+    std::string nextSegmentPath();
+
+    std::string dir;
+    uint32_t nextSegmentId = 0;
+
+    std::mutex mtx;  // segments, active builder
+    std::vector<std::unique_ptr<Segment>> segments;  // oldest first
+    SegmentBuilder active;
+
+    std::mutex pendingMtx;
+    std::condition_variable pendingCv;
+    std::deque<Pending> pending;
+    std::atomic<size_t> droppedDocs{0};
+    bool stopping = false;
+    std::thread indexer;
+};
@@ -0,0 +1,30 @@
+// shared/sha256.h
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// SHA-256 (FIPS 180-4), used to name attachments by content
+class Sha256 {
+public:
+    Sha256();
+
+    void update(const void *data, size_t len);
+    // Lowercase hex digest; the object is spent afterwards
+    std::string hexDigest();
+
+    // Hash a whole file; empty string if it cannot be read
+    static std::string ofFile(const std::string &path);
+    // 64 lowercase hex characters, safe to use as a file name
+    static bool isDigest(const std::string &s);
+
+private:
+    void block(const unsigned char *p);
+
+    std::array<uint32_t, 8> h;
+    unsigned char buf[64];
+    size_t bufLen = 0;
+    uint64_t totalBytes = 0;
+};
@@ -0,0 +1,267 @@
+// shared/shm_bus.cpp
+#include "shm_bus.h"
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+namespace {
+
+constexpr uint64_t BUS_MAGIC = 0x3130535542434721ULL;  // "!GCBUS01"
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void futexWait(std::atomic<uint32_t> *word, uint32_t expected, int timeoutMs) {
+    timespec ts;
+    ts.tv_sec  = timeoutMs / 1000;
+    ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT,
+            expected, &ts, nullptr, 0);
+}
+
+void futexWakeAll(std::atomic<uint32_t> *word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE,
+            INT_MAX, nullptr, nullptr, 0);
+}
+
+bool processAlive(int32_t pid) {
+    return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+} // namespace
+
+// Lives at the start of the shared object; every field is accessed
+// atomically because several processes map it
+struct ShmBus::Header {
+    std::atomic<uint64_t> magic;        // set last by the creator
+    std::atomic<uint64_t> writeSeq;     // next sequence number to reserve
+    std::atomic<uint64_t> arenaHead;    // next arena byte to reserve
+    std::atomic<uint32_t> wakeWord;     // futex: bumped on every publish
+    std::atomic<uint32_t> sleepers;     // readers inside futexWait
+    std::atomic<int32_t>  members[MAX_MEMBERS];  // pid per member slot
+};
+
+// state == 2*seq + 1 while being written, 2*seq + 2 once committed
+struct ShmBus::Slot {
+    std::atomic<uint64_t> state;
+    std::atomic<uint64_t> arenaPos;     // absolute; offset = pos % ARENA_BYTES
+    std::atomic<uint64_t> meta;         // group | origin << 16 | socket << 32
+    std::atomic<uint32_t> length;
+    uint32_t pad;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared memory bus needs lock-free 64-bit atomics");
+
+std::unique_ptr<ShmBus> ShmBus::attach(const std::string &name) {
+    std::unique_ptr<ShmBus> bus(new ShmBus());
+    bus->shmName = "/groupchat-" + name;
+
+    size_t headerBytes = (sizeof(Header) + 63) & ~size_t(63);
+    size_t slotBytes   = sizeof(Slot) * SLOTS;
+    bus->mappedBytes   = headerBytes + slotBytes + ARENA_BYTES;
+
+    bool created = true;
+    int fd = shm_open(bus->shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(bus->shmName.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0) return nullptr;
+
+    if (created) {
+        if (ftruncate(fd, bus->mappedBytes) < 0) {
+            close(fd);
+            shm_unlink(bus->shmName.c_str());
+            return nullptr;
+        }
+    } else {
+        // The creator may still be sizing it
+        struct stat st{};
+        for (int i = 0; i < 100; ++i) {
+            if (fstat(fd, &st) == 0 && (size_t)st.st_size >= bus->mappedBytes) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if ((size_t)st.st_size < bus->mappedBytes) {
+            close(fd);
+            return nullptr;
+        }
+    }
+
+    void *base = mmap(nullptr, bus->mappedBytes, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return nullptr;
+
+    bus->base   = base;
+    bus->header = static_cast<Header*>(base);
+    bus->slots  = reinterpret_cast<Slot*>(static_cast<char*>(base) + headerBytes);
+    bus->arena  = static_cast<char*>(base) + headerBytes + slotBytes;
+
+    Header *h = bus->header;
+    if (created) {
+        // ftruncate zero-filled everything; publishing the magic makes
+        // the bus usable for everyone else
+        h->magic.store(BUS_MAGIC, std::memory_order_release);
+    } else {
+        for (int i = 0; i < 100 && h->magic.load(std::memory_order_acquire) != BUS_MAGIC; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (h->magic.load(std::memory_order_acquire) != BUS_MAGIC) return nullptr;
+    }
+
+    // Claim a member slot, reclaiming ones left by processes that died
+    int32_t self = getpid();
+    for (int i = 0; i < MAX_MEMBERS && bus->member == 0; ++i) {
+        int32_t cur = h->members[i].load();
+        if (cur != 0 && processAlive(cur)) continue;
+        if (h->members[i].compare_exchange_strong(cur, self))
+            bus->member = static_cast<uint16_t>(i + 1);
+    }
+    if (bus->member == 0) return nullptr;
+
+    bus->cursor = h->writeSeq.load(std::memory_order_acquire);
+    bus->scratch.resize(MAX_MESSAGE);
+    return bus;
+}
+
+ShmBus::~ShmBus() {
+    if (!header) return;
+
+    if (member) header->members[member - 1].store(0);
+
+    bool others = false;
+    for (int i = 0; i < MAX_MEMBERS; ++i) {
+        if (processAlive(header->members[i].load())) others = true;
+    }
+    munmap(base, mappedBytes);
+    if (!others) shm_unlink(shmName.c_str());
+}
+
+bool ShmBus::publish(uint16_t groupID, uint32_t originSocket,
+                     const void *data, uint32_t length) {
+    if (length > MAX_MESSAGE) return false;
+
+    uint64_t seq = header->writeSeq.fetch_add(1, std::memory_order_acq_rel);
+    uint64_t pos = header->arenaHead.fetch_add(length, std::memory_order_acq_rel);
+
+    Slot &slot = slots[seq & (SLOTS - 1)];
+    slot.state.store(2 * seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // Copy into the arena, wrapping at the end
+    uint64_t off   = pos % ARENA_BYTES;
+    uint64_t first = length < ARENA_BYTES - off ? length : ARENA_BYTES - off;
+    std::memcpy(arena + off, data, first);
+    std::memcpy(arena, static_cast<const char*>(data) + first, length - first);
+
+    slot.arenaPos.store(pos, std::memory_order_relaxed);
+    slot.meta.store(uint64_t(groupID) | (uint64_t(member) << 16) |
+                    (uint64_t(originSocket) << 32), std::memory_order_relaxed);
+    slot.length.store(length, std::memory_order_relaxed);
+    slot.state.store(2 * seq + 2, std::memory_order_release);
+
+    // seq_cst pairs with the reader's sleepers increment: either the
+    // reader sees the new wakeWord or we see it sleeping
+    header->wakeWord.fetch_add(1);
+    if (header->sleepers.load() > 0)
+        futexWakeAll(&header->wakeWord);
+    return true;
+}
+
+size_t ShmBus::drain(const std::function<void(const BusMessage &)> &fn) {
+    size_t delivered = 0;
+
+    while (true) {
+        uint64_t head = header->writeSeq.load(std::memory_order_acquire);
+        if (cursor >= head) break;
+
+        if (head - cursor > SLOTS) {
+            lostCount += head - SLOTS - cursor;
+            cursor = head - SLOTS;
+        }
+
+        Slot &slot = slots[cursor & (SLOTS - 1)];
+        uint64_t want  = 2 * cursor + 2;
+        uint64_t state = slot.state.load(std::memory_order_acquire);
+
+        if (state < want) {
+            // Reserved but not committed yet. Normally a few hundred ns;
+            // a writer that died mid-publish must not wedge everyone.
+            int64_t now = nowMs();
+            if (stallSinceMs < 0) stallSinceMs = now;
+            if (now - stallSinceMs < STALL_MS) break;
+            ++lostCount;
+            ++cursor;
+            stallSinceMs = -1;
+            continue;
+        }
+        stallSinceMs = -1;
+        if (state > want) {  // lapped: this sequence was overwritten
+            ++lostCount;
+            ++cursor;
+            continue;
+        }
+
+        uint64_t pos  = slot.arenaPos.load(std::memory_order_relaxed);
+        uint64_t meta = slot.meta.load(std::memory_order_relaxed);
+        uint32_t len  = slot.length.load(std::memory_order_relaxed);
+        if (len > MAX_MESSAGE) len = MAX_MESSAGE;
+
+        uint64_t off   = pos % ARENA_BYTES;
+        uint64_t first = len < ARENA_BYTES - off ? len : ARENA_BYTES - off;
+        std::memcpy(scratch.data(), arena + off, first);
+        std::memcpy(scratch.data() + first, arena, len - first);
+
+        // Valid only if the slot was not reused and no writer has since
+        // reserved arena bytes over [pos, pos + len)
+        std::atomic_thread_fence(std::memory_order_acquire);
+        bool intact = slot.state.load(std::memory_order_relaxed) == want &&
+                      header->arenaHead.load(std::memory_order_relaxed) <= pos + ARENA_BYTES;
+        uint64_t seq = cursor++;
+        if (!intact) {
+            ++lostCount;
+            continue;
+        }
+
+        BusMessage msg;
+        msg.seq          = seq;
+        msg.groupID      = static_cast<uint16_t>(meta & 0xffff);
+        msg.origin       = static_cast<uint16_t>((meta >> 16) & 0xffff);
+        msg.originSocket = static_cast<uint32_t>(meta >> 32);
+        msg.data         = scratch.data();
+        msg.length       = len;
+        if (msg.origin == member) continue;  // delivered locally already
+
+        fn(msg);
+        ++delivered;
+    }
+    return delivered;
+}
+
+size_t ShmBus::poll(const std::function<void(const BusMessage &)> &fn, int timeoutMs) {
+    size_t n = drain(fn);
+    if (n) return n;
+
+    uint32_t word = header->wakeWord.load(std::memory_order_acquire);
+    n = drain(fn);
+    if (n) return n;
+
+    // While a slot is stalled, wake up soon enough to skip it on time
+    int wait = stallSinceMs >= 0 && timeoutMs > STALL_MS ? STALL_MS : timeoutMs;
+    header->sleepers.fetch_add(1);
+    futexWait(&header->wakeWord, word, wait);
+    header->sleepers.fetch_sub(1);
+    return drain(fn);
+}
@@ -0,0 +1,79 @@
+// shared/shm_bus.h
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Broadcast bus between processes on one host, in a POSIX shared memory
+// object. Message bytes are copied once into a shared byte arena; a ring
+// of slots records each message's arena offset and length. Every member
+// reads every slot with its own cursor, so one publish reaches all other
+// processes. Slots are guarded by a sequence stamp (seqlock style) and
+// readers validate the arena range after copying, so a reader that falls
+// a full lap behind detects the overwrite and counts it instead of
+// delivering torn data. Idle readers sleep on a shared futex.
+
+struct BusMessage {
+    uint64_t seq;
+    uint16_t groupID;
+    uint16_t origin;        // publishing member
+    uint32_t originSocket;  // client socket on the publishing process
+    const char *data;       // valid until the callback returns
+    uint32_t length;
+};
+
+class ShmBus {
+public:
+    static constexpr uint32_t SLOTS       = 4096;             // power of two
+    static constexpr uint64_t ARENA_BYTES = 4 * 1024 * 1024;
+    static constexpr uint32_t MAX_MESSAGE = 64 * 1024;
+    static constexpr int      MAX_MEMBERS = 64;
+    static constexpr int      STALL_MS    = 50;  // skip a slot a writer never finished
+
+    // Open (creating if needed) the bus "/groupchat-<name>". Returns null
+    // if shared memory is unavailable or the bus is full.
+    static std::unique_ptr<ShmBus> attach(const std::string &name);
+    ~ShmBus();
+
+    ShmBus(const ShmBus &) = delete;
+    ShmBus &operator=(const ShmBus &) = delete;
+
+    // 1..MAX_MEMBERS, stable while this process stays attached
+    uint16_t memberID() const { return member; }
+
+    bool publish(uint16_t groupID, uint32_t originSocket,
+                 const void *data, uint32_t length);
+
+    // Deliver messages published by other members since the last call,
+    // waiting up to timeoutMs for the first one. Returns how many.
+    size_t poll(const std::function<void(const BusMessage &)> &fn, int timeoutMs);
+
+    // Messages this member missed (lapped by writers or abandoned slots)
+    uint64_t lost() const { return lostCount; }
+
+private:
+    struct Header;
+    struct Slot;
+
+    ShmBus() = default;
+
+    size_t drain(const std::function<void(const BusMessage &)> &fn);
+
+    std::string shmName;
+    void *base = nullptr;
+    size_t mappedBytes = 0;
+    Header *header = nullptr;
+    Slot *slots = nullptr;
+    char *arena = nullptr;
+    uint16_t member = 0;
+
+    // Reader state, private to this process
+    uint64_t cursor = 0;
+    uint64_t lostCount = 0;
+    int64_t stallSinceMs = -1;
+    std::vector<char> scratch;
+};
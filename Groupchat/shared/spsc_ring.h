@@ -0,0 +1,52 @@
+// shared/spsc_ring.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free single-producer/single-consumer ring.
+// Exactly one thread may call tryPush and exactly one may call tryPop.
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscRing capacity must be a power of two");
+
+public:
+    bool tryPush(const T &value) {
+        size_t tail = tailIdx.load(std::memory_order_relaxed);
+        if (tail - headCache == Capacity) {
+            headCache = headIdx.load(std::memory_order_acquire);
+            if (tail - headCache == Capacity) return false;
+        }
+        slots[tail & (Capacity - 1)] = value;
+        tailIdx.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T &out) {
+        size_t head = headIdx.load(std::memory_order_relaxed);
+        if (head == tailCache) {
+            tailCache = tailIdx.load(std::memory_order_acquire);
+            if (head == tailCache) return false;
+        }
+        out = slots[head & (Capacity - 1)];
+        headIdx.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return tailIdx.load(std::memory_order_acquire) -
+               headIdx.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    // Producer and consumer indices on separate cache lines; each side
+    // keeps a cached copy of the other's index to avoid bouncing lines.
+    alignas(64) std::atomic<size_t> headIdx{0};
+    size_t tailCache = 0;                 // consumer's view of tail
+    alignas(64) std::atomic<size_t> tailIdx{0};
+    size_t headCache = 0;                 // producer's view of head
+    alignas(64) T slots[Capacity];
+};
@@ -0,0 +1,166 @@
+// shared/text_search.cpp
+#include "text_search.h"
+#include <cctype>
+
+#if defined(__x86_64__)
+#define TEXT_SEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+inline char fold(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+}
+
+// Compare the middle of a candidate match (first/last bytes already equal)
+inline bool equalsFolded(const char *hay, const char *needleLower, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (fold(hay[i]) != needleLower[i]) return false;
+    }
+    return true;
+}
+
+long findScalar(const char *hay, size_t n, const char *needle, size_t m,
+                size_t from = 0) {
+    for (size_t i = from; i + m <= n; ++i) {
+        if (fold(hay[i]) == needle[0] && equalsFolded(hay + i, needle, m))
+            return static_cast<long>(i);
+    }
+    return -1;
+}
+
+#ifdef TEXT_SEARCH_X86
+
+// Lowercase A-Z in 16 bytes: signed compares are fine because every
+// non-ASCII byte is negative and so outside the 'A'..'Z' range.
+inline __m128i fold16(__m128i v) {
+    __m128i ge = _mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1));
+    __m128i le = _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1));
+    return _mm_or_si128(v, _mm_and_si128(_mm_and_si128(ge, le),
+                                         _mm_set1_epi8(0x20)));
+}
+
+// Generic SIMD substring search: compare the first and last needle byte
+// against 16 haystack positions at once, verify only the candidates.
+long findSse2(const char *hay, size_t n, const char *needle, size_t m) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last  = _mm_set1_epi8(needle[m - 1]);
+
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i a = fold16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i)));
+        __m128i b = fold16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i + m - 1)));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                                                        _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (m <= 2 || equalsFolded(hay + i + bit + 1, needle + 1, m - 2))
+                return static_cast<long>(i + bit);
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(hay, n, needle, m, i);
+}
+
+__attribute__((target("avx2")))
+inline __m256i fold32(__m256i v) {
+    __m256i ge = _mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1));
+    __m256i le = _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v);
+    return _mm256_or_si256(v, _mm256_and_si256(_mm256_and_si256(ge, le),
+                                               _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+long findAvx2(const char *hay, size_t n, const char *needle, size_t m) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last  = _mm256_set1_epi8(needle[m - 1]);
+
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i a = fold32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay + i)));
+        __m256i b = fold32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay + i + m - 1)));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (m <= 2 || equalsFolded(hay + i + bit + 1, needle + 1, m - 2))
+                return static_cast<long>(i + bit);
+            mask &= mask - 1;
+        }
+    }
+    long rest = findSse2(hay + i, n - i, needle, m);
+    return rest < 0 ? -1 : static_cast<long>(i) + rest;
+}
+
+#endif // TEXT_SEARCH_X86
+
+using FindFn = long (*)(const char *, size_t, const char *, size_t);
+
+FindFn pickImplementation(const char **name) {
+#ifdef TEXT_SEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return findAvx2;
+    }
+    *name = "sse2";
+    return findSse2;
+#else
+    *name = "scalar";
+    return [](const char *h, size_t n, const char *nd, size_t m) {
+        return findScalar(h, n, nd, m);
+    };
+#endif
+}
+
+const char *implName = nullptr;
+const FindFn findImpl = pickImplementation(&implName);
+
+} // namespace
+
+namespace TextSearch {
+
+long findIgnoreCase(const char *hay, size_t hayLen,
+                    const char *needleLower, size_t needleLen) {
+    if (needleLen == 0) return 0;
+    if (needleLen > hayLen) return -1;
+    return findImpl(hay, hayLen, needleLower, needleLen);
+}
+
+const char *implementation() {
+    return implName;
+}
+
+} // namespace TextSearch
+
+TextMatcher::TextMatcher(const std::string &query) {
+    std::string current;
+    bool quoted = false;
+
+    auto flush = [this, &current]() {
+        if (!current.empty()) terms.push_back(current);
+        current.clear();
+    };
+
+    for (char c : query) {
+        if (c == '"') {
+            flush();
+            quoted = !quoted;
+        } else if (!quoted && std::isspace(static_cast<unsigned char>(c))) {
+            flush();
+        } else {
+            current += fold(c);
+        }
+    }
+    flush();
+}
+
+bool TextMatcher::matches(const char *text, size_t len) const {
+    if (terms.empty()) return false;
+    for (const auto &t : terms) {
+        if (TextSearch::findIgnoreCase(text, len, t.data(), t.size()) < 0)
+            return false;
+    }
+    return true;
+}
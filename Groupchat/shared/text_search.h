@@ -0,0 +1,40 @@
+// shared/text_search.h
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Case-insensitive (ASCII) substring search. Uses AVX2 when the CPU has
+// it, SSE2 on any other x86-64, and a scalar loop elsewhere.
+namespace TextSearch {
+
+// Position of needleLower in hay, or -1. The needle must already be
+// lowercase; the haystack is folded on the fly.
+long findIgnoreCase(const char *hay, size_t hayLen,
+                    const char *needleLower, size_t needleLen);
+
+// Which implementation findIgnoreCase dispatches to ("avx2", ...)
+const char *implementation();
+
+} // namespace TextSearch
+
+// A parsed search query. Whitespace-separated words must all appear
+// (in any order); a "double quoted phrase" is matched as one substring.
+class TextMatcher {
+public:
+    explicit TextMatcher(const std::string &query);
+
+    bool empty() const { return terms.empty(); }
+    bool matches(const char *text, size_t len) const;
+
+    // Fixed-width, NUL-padded field such as ChatPacket::payload
+    template <size_t N>
+    bool matches(const char (&field)[N]) const {
+        return matches(field, strnlen(field, N));
+    }
+
+private:
+    std::vector<std::string> terms;  // lowercase
+};
@@ -0,0 +1,145 @@
+// shared/wire.h
+#pragma once
+
+#include "protocol.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Field-by-field wire codecs generated from a compile-time layout.
+// Each Layout lists (member, wire offset) pairs; static_asserts check
+// that the fields tile the message exactly, so every wire byte is
+// written on encode and every member is assigned on decode. Integers
+// are big-endian and go through memcpy, so decoding straight out of a
+// receive buffer never does a misaligned or type-punned load.
+namespace Wire {
+
+template <typename M> struct MemberTraits;
+template <typename C, typename T> struct MemberTraits<T C::*> {
+    using Owner = C;
+    using Type  = T;
+};
+
+template <typename T>
+inline void storeBE(unsigned char *out, T v) {
+    static_assert(std::is_unsigned<T>::value, "wire integers are unsigned");
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out[i] = static_cast<unsigned char>(v >> (8 * (sizeof(T) - 1 - i)));
+    }
+}
+
+template <typename T>
+inline T loadBE(const unsigned char *in) {
+    T v = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        v = static_cast<T>((v << 8) | in[i]);
+    }
+    return v;
+}
+
+template <auto Member, size_t Offset>
+struct Field {
+    using Owner = typename MemberTraits<decltype(Member)>::Owner;
+    using Type  = typename MemberTraits<decltype(Member)>::Type;
+
+    static_assert(std::is_unsigned<Type>::value ||
+                  (std::is_array<Type>::value &&
+                   sizeof(typename std::remove_extent<Type>::type) == 1),
+                  "wire fields are unsigned integers or byte arrays");
+
+    static constexpr size_t offset = Offset;
+    static constexpr size_t size   = sizeof(Type);
+
+    static void encode(const Owner &obj, unsigned char *out) {
+        if constexpr (std::is_array<Type>::value) {
+            std::memcpy(out + Offset, obj.*Member, size);
+        } else {
+            storeBE(out + Offset, obj.*Member);
+        }
+    }
+
+    static void decode(const unsigned char *in, Owner &obj) {
+        if constexpr (std::is_array<Type>::value) {
+            std::memcpy(obj.*Member, in + Offset, size);
+        } else {
+            obj.*Member = loadBE<Type>(in + Offset);
+        }
+    }
+};
+
+template <typename T, size_t WireSize, typename... Fields>
+struct Layout {
+    using Message = T;
+    static constexpr size_t size = WireSize;
+
+    // Fields in offset order, no gaps, no overlap, ending at WireSize
+    static constexpr bool tiles() {
+        size_t offsets[] = {Fields::offset...};
+        size_t sizes[]   = {Fields::size...};
+        size_t next = 0;
+        for (size_t i = 0; i < sizeof...(Fields); ++i) {
+            if (offsets[i] != next) return false;
+            next += sizes[i];
+        }
+        return next == WireSize;
+    }
+
+    static_assert(tiles(), "wire layout must cover every byte exactly once");
+    static_assert((std::is_same<typename Fields::Owner, T>::value && ...),
+                  "every field must belong to the message type");
+
+    static void encode(const T &msg, unsigned char (&out)[WireSize]) {
+        (Fields::encode(msg, out), ...);
+    }
+
+    static void decode(const unsigned char *in, T &msg) {
+        (Fields::decode(in, msg), ...);
+    }
+};
+
+using ChatPacketLayout = Layout<ChatPacket, 272,
+    Field<&ChatPacket::type,       0>,
+    Field<&ChatPacket::reserved0,  1>,
+    Field<&ChatPacket::groupID,    2>,
+    Field<&ChatPacket::senderID,   4>,
+    Field<&ChatPacket::epoch,      6>,
+    Field<&ChatPacket::timestamp,  8>,
+    Field<&ChatPacket::seq,        12>,
+    Field<&ChatPacket::senderName, 16>,
+    Field<&ChatPacket::payload,    48>>;
+
+using AudioFrameHeaderLayout = Layout<AudioFrameHeader, 24,
+    Field<&AudioFrameHeader::seq,           0>,
+    Field<&AudioFrameHeader::length,        4>,
+    Field<&AudioFrameHeader::captureMicros, 8>,
+    Field<&AudioFrameHeader::groupID,       16>,
+    Field<&AudioFrameHeader::streamID,      18>,
+    Field<&AudioFrameHeader::reserved,      20>>;
+
+// The raw-struct path (to_network + send(&pkt)) and these codecs must
+// produce the same bytes
+static_assert(ChatPacketLayout::size == sizeof(ChatPacket), "ChatPacket size drift");
+static_assert(AudioFrameHeaderLayout::size == sizeof(AudioFrameHeader),
+              "AudioFrameHeader size drift");
+
+constexpr size_t PACKET_SIZE = ChatPacketLayout::size;
+
+// Every client message type currently shares the ChatPacket layout; a
+// type with its own body specializes this
+template <MessageType Type>
+struct MessageLayout {
+    using type = ChatPacketLayout;
+};
+
+inline void encode(const ChatPacket &pkt, unsigned char (&out)[PACKET_SIZE]) {
+    ChatPacketLayout::encode(pkt, out);
+}
+
+inline ChatPacket decode(const unsigned char *in) {
+    ChatPacket pkt;
+    ChatPacketLayout::decode(in, pkt);
+    return pkt;
+}
+
+} // namespace Wire
@@ -0,0 +1,111 @@
+// tests/audio_bench.cpp
+// Relay latency/jitter benchmark: N streams, each a sender and a listener
+// in their own audio group, sending 50 frames/sec through the server.
+// Usage: audio_bench [streams] [seconds] [port]
+// (start the server with at least 2*streams worker threads)
+#include "client/audio_client.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct StreamStats {
+    size_t received = 0;
+    double jitterMicros = 0;          // RFC 3550 interarrival jitter
+    std::vector<uint64_t> latencies;  // capture -> receive, microseconds
+};
+
+int main(int argc, char *argv[]) {
+    int streams = argc >= 2 ? std::stoi(argv[1]) : 8;
+    int seconds = argc >= 3 ? std::stoi(argv[2]) : 5;
+    int port    = argc >= 4 ? std::stoi(argv[3]) : 8080;
+
+    const int fps = 50;
+    const int framesPerStream = fps * seconds;
+    const std::vector<char> frame(320, 0);  // 20 ms of 8 kHz 16-bit audio
+
+    std::vector<std::unique_ptr<AudioClient>> senders, listeners;
+    for (int s = 0; s < streams; ++s) {
+        uint16_t group = static_cast<uint16_t>(1000 + s);
+        auto tx = std::make_unique<AudioClient>("127.0.0.1", port);
+        auto rx = std::make_unique<AudioClient>("127.0.0.1", port);
+        if (!tx->connect() || !rx->connect() ||
+            !rx->joinGroup(group) || !tx->joinGroup(group)) {
+            std::cerr << "stream " << s << " failed to join\n";
+            return 1;
+        }
+        senders.push_back(std::move(tx));
+        listeners.push_back(std::move(rx));
+    }
+
+    std::vector<StreamStats> stats(streams);
+    std::vector<std::thread> threads;
+
+    for (int s = 0; s < streams; ++s) {
+        threads.emplace_back([&, s]() {
+            StreamStats &st = stats[s];
+            st.latencies.reserve(framesPerStream);
+            bool first = true;
+            int64_t prevTransit = 0;
+            char payload[MAX_AUDIO_PAYLOAD];
+            while (st.received < (size_t)framesPerStream) {
+                AudioFrameHeader hdr{};
+                if (!listeners[s]->receiveFrame(hdr, payload, sizeof(payload))) break;
+                int64_t transit = (int64_t)(current_micros() - hdr.captureMicros);
+                if (!first) {
+                    double d = std::fabs((double)(transit - prevTransit));
+                    st.jitterMicros += (d - st.jitterMicros) / 16.0;
+                }
+                first = false;
+                prevTransit = transit;
+                st.latencies.push_back(transit);
+                ++st.received;
+            }
+        });
+    }
+
+    for (int s = 0; s < streams; ++s) {
+        threads.emplace_back([&, s]() {
+            auto next = std::chrono::steady_clock::now();
+            for (int i = 0; i < framesPerStream; ++i) {
+                senders[s]->sendAudio(frame);
+                next += std::chrono::milliseconds(1000 / fps);
+                std::this_thread::sleep_until(next);
+            }
+            // Give the relay a moment, then unblock the listener
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            listeners[s]->interrupt();
+        });
+    }
+
+    for (auto &t : threads) t.join();
+
+    std::vector<uint64_t> all;
+    size_t received = 0;
+    double jitter = 0;
+    for (auto &st : stats) {
+        received += st.received;
+        jitter += st.jitterMicros;
+        all.insert(all.end(), st.latencies.begin(), st.latencies.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    auto pct = [&all](double p) -> uint64_t {
+        if (all.empty()) return 0;
+        return all[std::min(all.size() - 1, (size_t)(p * all.size()))];
+    };
+
+    size_t sent = (size_t)streams * framesPerStream;
+    std::cout << "Streams: " << streams << " @ " << fps << " fps for "
+              << seconds << " s\n";
+    std::cout << "Frames sent: " << sent << ", received: " << received
+              << " (" << (sent ? 100.0 * received / sent : 0) << "%)\n";
+    std::cout << "Latency p50: " << pct(0.50) << " us, p99: " << pct(0.99)
+              << " us, max: " << (all.empty() ? 0 : all.back()) << " us\n";
+    std::cout << "Mean jitter: " << (streams ? jitter / streams : 0) << " us\n";
+    return 0;
+}
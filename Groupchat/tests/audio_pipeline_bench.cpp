@@ -0,0 +1,81 @@
+// tests/audio_pipeline_bench.cpp
+// Headless AudioPipeline benchmark: a tone source streams through
+// capture -> encode -> send over a socketpair into recv -> decode -> play
+// with a null sink. No server or sound hardware needed.
+// Usage: audio_pipeline_bench [frames] [--paced]
+#include "client/audio_pipeline.h"
+#include <sys/socket.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+// Count every heap allocation so steady-state allocations can be checked
+static std::atomic<size_t> allocations{0};
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+int main(int argc, char *argv[]) {
+    size_t frames = 20000;
+    bool paced = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--paced") == 0) paced = true;
+        else frames = std::stoul(argv[i]);
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        perror("socketpair");
+        return 1;
+    }
+
+    AudioClient tx("local", 0), rx("local", 0);
+    tx.attach(fds[0], 1);
+    rx.attach(fds[1], 1);
+
+    ToneSource tone(440.0, paced, frames);
+    NullSink sink;
+    AudioPipeline sender(tx, &tone, nullptr);
+    AudioPipeline receiver(rx, nullptr, &sink);
+
+    using namespace std::chrono;
+    receiver.start();
+    auto start = steady_clock::now();
+    sender.start();
+
+    // Everything after the first frames are played is steady state
+    const size_t warmup = frames < 200 ? frames / 2 : 100;
+    while (sink.frames() < warmup) std::this_thread::sleep_for(microseconds(100));
+    size_t allocsBefore = allocations.load();
+
+    sender.waitForSource();
+    while (sink.frames() + receiver.framesDropped() < sender.framesSent())
+        std::this_thread::sleep_for(microseconds(100));
+    auto elapsed = duration_cast<microseconds>(steady_clock::now() - start).count();
+    size_t allocsAfter = allocations.load();
+
+    sender.stop();
+    receiver.stop();
+
+    double secs = elapsed / 1e6;
+    std::cout << "Frames played: " << sink.frames() << " of " << frames
+              << " (dropped tx " << sender.framesDropped()
+              << ", rx " << receiver.framesDropped() << ")\n";
+    std::cout << "Throughput: " << (secs > 0 ? sink.frames() / secs : 0)
+              << " frames/sec (" << (secs > 0 ? sink.frames() / secs / 50 : 0)
+              << "x real time)\n";
+    std::cout << "Latency mean: "
+              << (sink.frames() ? sink.totalLatencyMicros() / sink.frames() : 0)
+              << " us, max: " << sink.maxLatencyMicros() << " us\n";
+    std::cout << "Steady-state allocations: " << (allocsAfter - allocsBefore) << "\n";
+    return allocsAfter == allocsBefore ? 0 : 1;
+}
@@ -1,37 +1,139 @@
 // tests/bot_test.cpp
-#include "shared/protocol.h"
-#include <arpa/inet.h>
-#include <sys/socket.h>
-#include <unistd.h>
-#include <iostream>
+// Load generator: every bot is a ChatConnection on one event-loop
+// thread, spread round-robin over the groups. Each bot sends `messages`
+// texts at `rate` per second; the report compares what the other bots
+// in each group received against what was sent. Restart the server
+// mid-run to watch the bots reconnect and rejoin.
+//
+//   bot_test [bots] [messages] [port] [groups] [rate]
+#include "client/chat_connection.h"
+#include "shared/logger.h"
 #include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
-int main() {
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port   = htons(8080);
-    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+namespace {
 
-    connect(sock, (sockaddr*)&addr, sizeof(addr));
+struct Bot {
+    ChatConnection *conn = nullptr;
+    size_t sent = 0;
+    size_t rejected = 0;  // outbound queue full
+    // This run's texts from other bots; a set, since the history
+    // replayed after a rejoin repeats some of them
+    std::unordered_set<std::string> received;
+};
 
-    ChatPacket joinPkt = make_packet(MSG_JOIN, 1, "");
-    ChatPacket netJoin = to_network(joinPkt);
-    send(sock, &netJoin, sizeof(netJoin), 0);
+} // namespace
+
+int main(int argc, char *argv[]) {
+    size_t bots     = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1;
+    size_t messages = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+    int port        = argc > 3 ? std::atoi(argv[3]) : 8080;
+    size_t groups   = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 1;
+    double rate     = argc > 5 ? std::atof(argv[5]) : 10.0;  // server allows 20/s
+    if (bots == 0 || groups == 0 || rate <= 0) {
+        std::cerr << "Usage: bot_test [bots] [messages] [port] [groups] [rate]\n";
+        return 1;
+    }
 
     using namespace std::chrono;
-    auto start = high_resolution_clock::now();
+    // Tags this run's texts so replayed history from earlier runs is not counted
+    const std::string tag = "bot " + std::to_string(
+        duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count() % 1000000) + " ";
 
-    for (int i = 0; i < 100; ++i) {
-        ChatPacket pkt = make_packet(MSG_TEXT, 1, "bot message " + std::to_string(i));
-        ChatPacket net = to_network(pkt);
-        send(sock, &net, sizeof(net), 0);
+    ChatEventLoop loop;
+    std::vector<Bot> fleet(bots);
+    std::vector<size_t> members(groups + 1, 0);
+    for (size_t i = 0; i < bots; ++i) {
+        ChatConnection::Options opts;
+        opts.port     = port;
+        opts.username = "bot" + std::to_string(i);
+        opts.group    = static_cast<uint16_t>(1 + i % groups);
+        ++members[opts.group];
+
+        Bot &bot = fleet[i];
+        bot.conn = &loop.connect(opts, [&bot, &tag](ChatConnection &conn, const ChatPacket &pkt) {
+            // History can include the bot's own texts; those don't count
+            if (pkt.type == MSG_TEXT &&
+                std::strncmp(pkt.payload, tag.c_str(), tag.size()) == 0 &&
+                conn.username() != fixedField(pkt.senderName)) {
+                bot.received.insert(pkt.payload);
+            }
+        });
     }
 
-    auto end = high_resolution_clock::now();
-    auto ms = duration_cast<milliseconds>(end - start).count();
-    std::cout << "Sent 100 messages in " << ms << " ms\n";
+    // Wait for everyone to join before the clock starts
+    auto giveUp = steady_clock::now() + seconds(10);
+    size_t connected = 0;
+    while (steady_clock::now() < giveUp) {
+        loop.run(milliseconds(10));
+        connected = 0;
+        for (const auto &bot : fleet) {
+            if (bot.conn->state() == ChatConnection::State::CONNECTED) ++connected;
+        }
+        if (connected == bots) break;
+    }
+    if (connected < bots) {
+        std::cerr << "Only " << connected << " of " << bots << " bots connected\n";
+    }
+    // Let the JOINs land so the first texts reach every member
+    loop.run(milliseconds(200));
+
+    // Paced sends, every bot once per tick, with the loop running in between
+    auto interval = duration_cast<steady_clock::duration>(duration<double>(1.0 / rate));
+    auto start = steady_clock::now();
+    for (size_t k = 0; k < messages; ++k) {
+        auto due = start + k * interval;
+        for (auto now = steady_clock::now(); now < due; now = steady_clock::now()) {
+            loop.run(duration_cast<milliseconds>(due - now) + milliseconds(1));
+        }
+        for (size_t i = 0; i < bots; ++i) {
+            Bot &bot = fleet[i];
+            if (bot.conn->sendText(tag + std::to_string(i) + " " + std::to_string(k))) {
+                ++bot.sent;
+            } else {
+                ++bot.rejected;
+            }
+        }
+    }
+    auto sendMs = duration_cast<milliseconds>(steady_clock::now() - start).count();
+
+    // Drain: stop once the queues are empty and nothing more arrives
+    size_t lastReceived = SIZE_MAX;
+    auto drainUntil = steady_clock::now() + seconds(30);
+    while (steady_clock::now() < drainUntil) {
+        loop.run(milliseconds(500));
+        size_t received = 0, queued = 0;
+        for (const auto &bot : fleet) {
+            received += bot.received.size();
+            queued += bot.conn->queued();
+        }
+        if (queued == 0 && received == lastReceived) break;
+        lastReceived = received;
+    }
+
+    size_t sent = 0, rejected = 0, received = 0, expected = 0;
+    uint64_t reconnects = 0;
+    for (size_t i = 0; i < bots; ++i) {
+        const Bot &bot = fleet[i];
+        sent += bot.sent;
+        rejected += bot.rejected;
+        received += bot.received.size();
+        reconnects += bot.conn->reconnects();
+        expected += bot.sent * (members[1 + i % groups] - 1);
+    }
 
-    close(sock);
+    std::cout << "Bots: " << bots << " in " << groups << " group(s), "
+              << connected << " connected\n"
+              << "Sent " << sent << " messages in " << sendMs << " ms ("
+              << rejected << " rejected, queue full)\n"
+              << "Received " << received << " of " << expected << " deliveries";
+    if (expected > 0) std::cout << " (" << (100.0 * received / expected) << "%)";
+    std::cout << "\nReconnects: " << reconnects << "\n";
     return 0;
 }
@@ -0,0 +1,213 @@
+// tests/shm_bus_bench.cpp
+// Cross-process delivery latency: shared memory bus vs loopback TCP.
+// Forks a receiver process; the parent sends ChatPacket-sized messages
+// stamped with CLOCK_MONOTONIC (shared by both processes), paced so we
+// measure latency rather than throughput. Both receivers block in the
+// kernel when idle (futex for the bus, recv for TCP), as the server does.
+// Usage: shm_bus_bench [messages] [gapMicros]
+#include "shared/shm_bus.h"
+#include "shared/protocol.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+uint64_t monoNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Spin until `gap` has passed: sleep_for granularity would dominate
+void pace(uint64_t &next, uint64_t gapNanos) {
+    next += gapNanos;
+    while (monoNanos() < next) { }
+}
+
+ChatPacket stamped(uint32_t i) {
+    ChatPacket pkt = make_packet(MSG_TEXT, 1, "bench", 0, "bench");
+    uint64_t now = monoNanos();
+    std::memcpy(pkt.payload + 8, &i, sizeof(i));
+    std::memcpy(pkt.payload + 16, &now, sizeof(now));
+    return pkt;
+}
+
+uint64_t latencyOf(const ChatPacket &pkt) {
+    uint64_t sent;
+    std::memcpy(&sent, pkt.payload + 16, sizeof(sent));
+    return monoNanos() - sent;
+}
+
+// Child -> parent: raw latencies over a pipe
+void report(int fd, const std::vector<uint64_t> &lat) {
+    size_t n = lat.size();
+    (void)!write(fd, &n, sizeof(n));
+    const char *p = reinterpret_cast<const char*>(lat.data());
+    size_t left = n * sizeof(uint64_t);
+    while (left > 0) {
+        ssize_t w = write(fd, p, left);
+        if (w <= 0) break;
+        p += w;
+        left -= w;
+    }
+}
+
+std::vector<uint64_t> collect(int fd) {
+    size_t n = 0;
+    if (read(fd, &n, sizeof(n)) != sizeof(n)) return {};
+    std::vector<uint64_t> lat(n);
+    char *p = reinterpret_cast<char*>(lat.data());
+    size_t left = n * sizeof(uint64_t);
+    while (left > 0) {
+        ssize_t r = read(fd, p, left);
+        if (r <= 0) break;
+        p += r;
+        left -= r;
+    }
+    return lat;
+}
+
+void print(const char *name, std::vector<uint64_t> lat, size_t sent) {
+    if (lat.empty()) {
+        std::cout << name << ": nothing received\n";
+        return;
+    }
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&](double p) { return lat[std::min(lat.size() - 1, size_t(p * lat.size()))] / 1000.0; };
+    double sum = 0;
+    for (uint64_t v : lat) sum += v;
+    printf("%-10s received %zu/%zu  avg %.2f us  p50 %.2f us  p99 %.2f us  p99.9 %.2f us  max %.2f us\n",
+           name, lat.size(), sent, sum / lat.size() / 1000.0,
+           pct(0.50), pct(0.99), pct(0.999), lat.back() / 1000.0);
+}
+
+std::vector<uint64_t> benchBus(int messages, uint64_t gapNanos) {
+    std::string name = "bench-" + std::to_string(getpid());
+    auto bus = ShmBus::attach(name);  // keeps the object alive for the child
+    if (!bus) {
+        std::cerr << "cannot create shared memory bus\n";
+        return {};
+    }
+
+    int ready[2], results[2];
+    if (pipe(ready) < 0 || pipe(results) < 0) return {};
+
+    pid_t child = fork();
+    if (child == 0) {
+        bus.release();  // the parent's mapping; not ours to detach
+        auto rx = ShmBus::attach(name);
+        std::vector<uint64_t> lat;
+        lat.reserve(messages);
+        char ok = rx ? 1 : 0;
+        (void)!write(ready[1], &ok, 1);
+
+        auto started = std::chrono::steady_clock::now();
+        while (rx && (int)lat.size() < messages &&
+               std::chrono::steady_clock::now() - started < std::chrono::seconds(30)) {
+            rx->poll([&](const BusMessage &msg) {
+                ChatPacket pkt;
+                std::memcpy(&pkt, msg.data, sizeof(pkt));
+                lat.push_back(latencyOf(pkt));
+            }, 100);
+        }
+        report(results[1], lat);
+        _exit(0);
+    }
+
+    char ok = 0;
+    (void)!read(ready[0], &ok, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));  // let it block
+
+    uint64_t next = monoNanos();
+    for (int i = 0; i < messages && ok; ++i) {
+        ChatPacket pkt = stamped(i);
+        bus->publish(1, 0, &pkt, sizeof(pkt));
+        pace(next, gapNanos);
+    }
+
+    auto lat = collect(results[0]);
+    waitpid(child, nullptr, 0);
+    return lat;
+}
+
+std::vector<uint64_t> benchTcp(int messages, uint64_t gapNanos) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 1) < 0 ||
+        getsockname(listener, (sockaddr*)&addr, &len) < 0) {
+        perror("tcp setup");
+        return {};
+    }
+
+    int results[2];
+    if (pipe(results) < 0) return {};
+
+    pid_t child = fork();
+    if (child == 0) {
+        close(listener);
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        std::vector<uint64_t> lat;
+        lat.reserve(messages);
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+            ChatPacket pkt;
+            while ((int)lat.size() < messages) {
+                size_t got = 0;
+                while (got < sizeof(pkt)) {
+                    ssize_t n = recv(fd, reinterpret_cast<char*>(&pkt) + got, sizeof(pkt) - got, 0);
+                    if (n <= 0) break;
+                    got += n;
+                }
+                if (got < sizeof(pkt)) break;
+                lat.push_back(latencyOf(pkt));
+            }
+        }
+        report(results[1], lat);
+        _exit(0);
+    }
+
+    int fd = accept(listener, nullptr, nullptr);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    uint64_t next = monoNanos();
+    for (int i = 0; i < messages; ++i) {
+        ChatPacket pkt = stamped(i);
+        if (send(fd, &pkt, sizeof(pkt), 0) != sizeof(pkt)) break;
+        pace(next, gapNanos);
+    }
+
+    auto lat = collect(results[0]);
+    close(fd);
+    close(listener);
+    waitpid(child, nullptr, 0);
+    return lat;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    int messages = argc >= 2 ? std::stoi(argv[1]) : 20000;
+    uint64_t gapMicros = argc >= 3 ? std::stoul(argv[2]) : 50;
+
+    std::cout << "cross-process delivery, " << messages << " x "
+              << sizeof(ChatPacket) << "-byte messages, one every "
+              << gapMicros << " us\n";
+    print("shm bus", benchBus(messages, gapMicros * 1000), messages);
+    print("tcp lo", benchTcp(messages, gapMicros * 1000), messages);
+    return 0;
+}
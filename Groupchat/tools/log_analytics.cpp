@@ -0,0 +1,277 @@
+// tools/log_analytics.cpp
+// Aggregates over chat_log.txt: per-group and per-user message counts
+// and an hour-of-day (UTC) traffic profile.
+//   log_analytics <chat_log.txt> [--format csv|json] [--threads N] [--top N]
+// The log is memory-mapped and cut into one chunk per thread at newline
+// boundaries; each thread parses its chunk into private tables that are
+// merged at the end, so nothing is shared while parsing. User names are
+// views into the mapping and are only copied for output.
+#include "shared/chat_log.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct Counter {
+    uint64_t messages = 0;
+    uint64_t payloadBytes = 0;
+    uint32_t firstTs = UINT32_MAX;
+    uint32_t lastTs = 0;
+
+    void add(uint32_t ts, size_t bytes) {
+        ++messages;
+        payloadBytes += bytes;
+        firstTs = std::min(firstTs, ts);
+        lastTs = std::max(lastTs, ts);
+    }
+
+    void merge(const Counter &o) {
+        messages += o.messages;
+        payloadBytes += o.payloadBytes;
+        firstTs = std::min(firstTs, o.firstTs);
+        lastTs = std::max(lastTs, o.lastTs);
+    }
+};
+
+struct Aggregates {
+    uint64_t lines = 0;
+    uint64_t skipped = 0;  // headers and malformed lines
+    std::vector<Counter> groups = std::vector<Counter>(65536);  // by group id
+    std::unordered_map<std::string_view, Counter> users;
+    std::array<Counter, 24> hours{};
+
+    void merge(const Aggregates &o) {
+        lines += o.lines;
+        skipped += o.skipped;
+        for (size_t g = 0; g < groups.size(); ++g) groups[g].merge(o.groups[g]);
+        for (const auto &u : o.users) users[u.first].merge(u.second);
+        for (size_t h = 0; h < hours.size(); ++h) hours[h].merge(o.hours[h]);
+    }
+};
+
+int usage() {
+    std::cerr << "usage: log_analytics <chat_log.txt> [--format csv|json]"
+                 " [--threads N] [--top N]\n";
+    return 2;
+}
+
+void parseChunk(const char *begin, const char *end, Aggregates &out) {
+    const char *p = begin;
+    while (p < end) {
+        const char *nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        const char *lineEnd = nl ? nl : end;
+        ++out.lines;
+
+        LogEntry e;
+        if (parseLogLine(p, lineEnd - p, e)) {
+            out.groups[e.groupID].add(e.timestamp, e.payloadLen);
+            out.users[std::string_view(e.name, e.nameLen)].add(e.timestamp, e.payloadLen);
+            out.hours[(e.timestamp % 86400) / 3600].add(e.timestamp, e.payloadLen);
+        } else {
+            ++out.skipped;
+        }
+        p = lineEnd + 1;
+    }
+}
+
+// Chunk boundaries: each cut moves forward to just past a newline, so
+// every line belongs to exactly one chunk
+std::vector<const char*> splitAtLines(const char *data, size_t size, size_t parts) {
+    std::vector<const char*> cuts{data};
+    for (size_t i = 1; i < parts; ++i) {
+        const char *guess = data + size * i / parts;
+        if (guess <= cuts.back()) continue;
+        const char *nl = static_cast<const char*>(
+            std::memchr(guess, '\n', data + size - guess));
+        if (!nl) break;
+        cuts.push_back(nl + 1);
+    }
+    cuts.push_back(data + size);
+    return cuts;
+}
+
+std::string csvField(std::string_view s) {
+    if (s.find_first_of(",\"\n") == std::string_view::npos) return std::string(s);
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+std::string jsonString(std::string_view s) {
+    std::string out = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char esc[8];
+                    std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+                    out += esc;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+template <typename Key>
+std::vector<std::pair<Key, Counter>> byMessages(std::vector<std::pair<Key, Counter>> rows,
+                                                size_t top) {
+    std::sort(rows.begin(), rows.end(), [](const auto &a, const auto &b) {
+        if (a.second.messages != b.second.messages)
+            return a.second.messages > b.second.messages;
+        return a.first < b.first;
+    });
+    if (top && rows.size() > top) rows.resize(top);
+    return rows;
+}
+
+std::vector<std::pair<uint16_t, Counter>> groupRows(const Aggregates &agg) {
+    std::vector<std::pair<uint16_t, Counter>> rows;
+    for (size_t g = 0; g < agg.groups.size(); ++g) {
+        if (agg.groups[g].messages) rows.emplace_back(static_cast<uint16_t>(g), agg.groups[g]);
+    }
+    return byMessages(std::move(rows), 0);
+}
+
+std::vector<std::pair<std::string_view, Counter>> userRows(const Aggregates &agg, size_t top) {
+    return byMessages(std::vector<std::pair<std::string_view, Counter>>(
+        agg.users.begin(), agg.users.end()), top);
+}
+
+void writeCsv(const Aggregates &agg, size_t top) {
+    std::cout << "kind,key,messages,payload_bytes,first_ts,last_ts\n";
+    auto row = [](const char *kind, const std::string &key, const Counter &c) {
+        std::cout << kind << ',' << key << ',' << c.messages << ',' << c.payloadBytes
+                  << ',' << (c.messages ? c.firstTs : 0) << ',' << c.lastTs << '\n';
+    };
+    for (const auto &g : groupRows(agg)) row("group", std::to_string(g.first), g.second);
+    for (const auto &u : userRows(agg, top)) row("user", csvField(u.first), u.second);
+    for (size_t h = 0; h < agg.hours.size(); ++h) row("hour", std::to_string(h), agg.hours[h]);
+}
+
+void writeJson(const Aggregates &agg, size_t top) {
+    auto fields = [](const Counter &c) {
+        return "\"messages\": " + std::to_string(c.messages) +
+               ", \"payload_bytes\": " + std::to_string(c.payloadBytes) +
+               ", \"first_ts\": " + std::to_string(c.messages ? c.firstTs : 0) +
+               ", \"last_ts\": " + std::to_string(c.lastTs);
+    };
+
+    std::cout << "{\n  \"lines\": " << agg.lines << ",\n  \"skipped\": " << agg.skipped
+              << ",\n  \"groups\": [";
+    const char *sep = "\n";
+    for (const auto &g : groupRows(agg)) {
+        std::cout << sep << "    {\"group\": " << g.first << ", " << fields(g.second) << "}";
+        sep = ",\n";
+    }
+    std::cout << "\n  ],\n  \"users\": [";
+    sep = "\n";
+    for (const auto &u : userRows(agg, top)) {
+        std::cout << sep << "    {\"user\": " << jsonString(u.first) << ", "
+                  << fields(u.second) << "}";
+        sep = ",\n";
+    }
+    std::cout << "\n  ],\n  \"hours\": [";
+    sep = "\n";
+    for (size_t h = 0; h < agg.hours.size(); ++h) {
+        std::cout << sep << "    {\"hour\": " << h << ", " << fields(agg.hours[h]) << "}";
+        sep = ",\n";
+    }
+    std::cout << "\n  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) return usage();
+
+    std::string path = argv[1];
+    std::string format = "csv";
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t top = 0;  // 0 = every user
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--format" && hasValue) {
+            format = argv[++i];
+        } else if (arg == "--threads" && hasValue) {
+            threads = std::max(1ul, std::stoul(argv[++i]));
+        } else if (arg == "--top" && hasValue) {
+            top = std::stoul(argv[++i]);
+        } else {
+            return usage();
+        }
+    }
+    if (format != "csv" && format != "json") return usage();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "cannot open " << path << "\n";
+        return 1;
+    }
+    struct stat st{};
+    fstat(fd, &st);
+    size_t size = st.st_size;
+
+    auto started = std::chrono::steady_clock::now();
+    Aggregates total;
+    void *map = nullptr;
+    if (size > 0) {
+        map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            std::cerr << "cannot map " << path << "\n";
+            close(fd);
+            return 1;
+        }
+        // Each chunk is read front to back; let the kernel read ahead
+        madvise(map, size, MADV_SEQUENTIAL);
+
+        const char *data = static_cast<const char*>(map);
+        auto cuts = splitAtLines(data, size, threads);
+        std::vector<Aggregates> partial(cuts.size() - 1);
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+            workers.emplace_back(parseChunk, cuts[i], cuts[i + 1], std::ref(partial[i]));
+        }
+        for (auto &w : workers) w.join();
+        for (const auto &p : partial) total.merge(p);
+    }
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - started).count();
+
+    if (format == "json") {
+        writeJson(total, top);
+    } else {
+        writeCsv(total, top);
+    }
+
+    // Views into the mapping are dead after this
+    if (map) munmap(map, size);
+    close(fd);
+
+    std::fprintf(stderr, "parsed %zu lines (%.1f MB) in %.1f ms on %zu thread(s), %.0f MB/s\n",
+                 static_cast<size_t>(total.lines), size / 1e6, ms, threads,
+                 ms > 0 ? size / 1e3 / ms : 0.0);
+    return 0;
+}